@@ -0,0 +1,110 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "bench.h"
+#include "chip8.h"
+#include "recomp.h"
+
+/*
+ * Runs a ROM headless for BENCH_CYCLES cycles, once through the interpreter
+ * and once through a recompiled module, and reports both times.  Each run
+ * executes the given number of cycles and then ticks the timers, as the
+ * emulator does once a frame, so 10 cycles measures the emulator's own
+ * budget.  Both passes see the same keys and RND results and must end in
+ * the same state.
+ */
+
+/* Holds one key for 16 runs, then none for 16, stepping through 0-F */
+static void benchKeys(Chip8CPU* cpu, int32_t run)
+{
+    int32_t k;
+
+    for (k = 0; k < KEY_SIZE; k++) {
+        cpu->key[k] = ((run >> 4) & 1) && k == ((run >> 5) & 0xF);
+    }
+}
+
+static double benchPass(Chip8CPU* cpu, int32_t cycles, bool recompiled)
+{
+    uint64_t t0;
+    int32_t run, k;
+
+    srand(BENCH_SEED);
+    t0 = SDL_GetPerformanceCounter();
+    for (run = 0; run < BENCH_CYCLES / cycles; run++) {
+        benchKeys(cpu, run);
+        if (recompiled) {
+            recompRun(cpu, cycles);
+        } else {
+            for (k = 0; k < cycles; k++) {
+                cpuExecute(cpu);
+            }
+        }
+        cpuUpdateTimers(cpu);
+    }
+    return (double)(SDL_GetPerformanceCounter() - t0) / SDL_GetPerformanceFrequency();
+}
+
+static bool benchSame(const Chip8CPU* a, const Chip8CPU* b)
+{
+    return memcmp(a->V, b->V, sizeof(a->V)) == 0 &&
+           a->PC == b->PC && a->I == b->I && a->SP == b->SP &&
+           a->DT == b->DT && a->ST == b->ST &&
+           memcmp(a->stack, b->stack, sizeof(a->stack)) == 0 &&
+           memcmp(a->ram, b->ram, sizeof(a->ram)) == 0 &&
+           memcmp(a->framebuff, b->framebuff, sizeof(a->framebuff)) == 0;
+}
+
+static int32_t benchCompare(Chip8CPU** cpu, const char* file, const char* module, int32_t cycles)
+{
+    double interpTime, recompTime;
+
+    if (chip8LoadROM(cpu[0], file) <= 0 || chip8LoadROM(cpu[1], file) <= 0 ||
+        (module != NULL && recompLoad(cpu[1], module) != 0)) {
+        return -1;
+    }
+
+    printf("%s: %d cycles, %d per run\n", file, BENCH_CYCLES / cycles * cycles, cycles);
+    interpTime = benchPass(cpu[0], cycles, false);
+    printf("  interpreter %8.3f s\n", interpTime);
+    if (module == NULL) {
+        return 0;
+    }
+
+    recompTime = benchPass(cpu[1], cycles, true);
+    printf("  module      %8.3f s  %.1fx\n", recompTime, interpTime / recompTime);
+    if (!benchSame(cpu[0], cpu[1])) {
+        fprintf(stderr, "Module run ended in a different state from the interpreter.\n");
+        return -1;
+    }
+    return 0;
+}
+
+int32_t benchRun(const char* file, const char* module, int32_t cycles)
+{
+    Chip8CPU* cpu[2];
+    int32_t i, result;
+
+    if (cycles < 1 || cycles > BENCH_CYCLES) {
+        fprintf(stderr, "Benchmark runs 1 to %d cycles at a time.\n", BENCH_CYCLES);
+        return -1;
+    }
+
+    for (i = 0; i < 2; i++) {
+        cpu[i] = aligned_alloc(CPU_ALIGN, sizeof(Chip8CPU));
+        if (cpu[i] == NULL) {
+            fprintf(stderr, "malloc error.\n");
+            exit(1);
+        }
+        cpuInit(cpu[i]);
+    }
+
+    result = benchCompare(cpu, file, module, cycles);
+
+    recompUnload();
+    free(cpu[0]);
+    free(cpu[1]);
+    return result;
+}
@@ -0,0 +1,11 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+#define BENCH_CYCLES    20000000    /* about nine hours of emulated time */
+#define BENCH_SEED      1
+
+int32_t benchRun(const char* file, const char* module, int32_t cycles);
+
+#endif
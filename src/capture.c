@@ -0,0 +1,575 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "capture.h"
+#include "filter.h"
+
+/*
+ * Capture runs on a background encoder thread.  The emulation thread copies
+ * each frame into a preallocated slot of a single producer / single consumer
+ * ring and never waits: when the encoder falls behind the frame is dropped
+ * and the next queued frame records how many were skipped so the video keeps
+ * its timing.
+ */
+
+#define CAPTURE_VIDEO       0
+#define CAPTURE_SCREENSHOT  1
+
+#define FORMAT_Y4M          0
+#define FORMAT_GIF          1
+
+#define GIF_MAX_CODES       4096
+
+typedef struct {
+    uint8_t     type;
+    uint32_t    skipped;
+    uint8_t     framebuff[FRAMEBUFF_SIZE];
+} CaptureSlot;
+
+static CaptureSlot pool[CAPTURE_POOL_SIZE];
+static SDL_atomic_t head;
+static SDL_atomic_t tail;
+static SDL_atomic_t running;
+static SDL_sem* ready = NULL;
+static SDL_Thread* thread = NULL;
+
+/* Producer side */
+static uint32_t skipped = 0;
+static uint32_t dropped = 0;
+
+/* Encoder side */
+static FILE* video = NULL;
+static int32_t format = FORMAT_Y4M;
+static uint8_t last[FRAMEBUFF_SIZE];
+static bool haveLast = false;
+static uint32_t pendingFrames = 0;
+static uint64_t framesWritten = 0;
+static uint32_t screenshots = 0;
+static uint8_t scaled[CAPTURE_WIDTH * CAPTURE_HEIGHT];
+static uint8_t yuv[CAPTURE_WIDTH * CAPTURE_HEIGHT * 3 / 2];
+static uint32_t crcTable[256];
+
+static void captureScale(const uint8_t* framebuff)
+{
+    int32_t x, y;
+    uint8_t* row;
+
+    for (y = 0; y < SCREEN_HEIGHT; y++) {
+        row = &scaled[y * CAPTURE_SCALE * CAPTURE_WIDTH];
+        for (x = 0; x < SCREEN_WIDTH; x++) {
+            memset(&row[x * CAPTURE_SCALE], framebuff[y * SCREEN_WIDTH + x] ? 1 : 0, CAPTURE_SCALE);
+        }
+        for (x = 1; x < CAPTURE_SCALE; x++) {
+            memcpy(&row[x * CAPTURE_WIDTH], row, CAPTURE_WIDTH);
+        }
+    }
+}
+
+static void putLE16(FILE* fp, uint32_t value)
+{
+    fputc(value & 0xFF, fp);
+    fputc((value >> 8) & 0xFF, fp);
+}
+
+static void putBE32(FILE* fp, uint32_t value)
+{
+    fputc((value >> 24) & 0xFF, fp);
+    fputc((value >> 16) & 0xFF, fp);
+    fputc((value >> 8) & 0xFF, fp);
+    fputc(value & 0xFF, fp);
+}
+
+/* ---- Y4M ---------------------------------------------------------------- */
+
+static void y4mConvert(const uint8_t* framebuff)
+{
+    palette_t pal = filterGetPalette();
+    uint32_t colors[2] = { pal.bg, pal.fg };
+    uint8_t Y[2], U[2], V[2];
+    uint8_t* planeU = &yuv[CAPTURE_WIDTH * CAPTURE_HEIGHT];
+    uint8_t* planeV = planeU + CAPTURE_WIDTH * CAPTURE_HEIGHT / 4;
+    int32_t i, r, g, b, x, y;
+
+    /* BT.601 studio range */
+    for (i = 0; i < 2; i++) {
+        r = (colors[i] >> 16) & 0xFF;
+        g = (colors[i] >> 8) & 0xFF;
+        b = colors[i] & 0xFF;
+        Y[i] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+        U[i] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+        V[i] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+    }
+
+    captureScale(framebuff);
+    for (i = 0; i < CAPTURE_WIDTH * CAPTURE_HEIGHT; i++) {
+        yuv[i] = Y[ scaled[i] ];
+    }
+
+    /* Every 2x2 chroma block lies inside one scaled CHIP-8 pixel */
+    for (y = 0; y < CAPTURE_HEIGHT / 2; y++) {
+        for (x = 0; x < CAPTURE_WIDTH / 2; x++) {
+            i = scaled[(2 * y) * CAPTURE_WIDTH + 2 * x];
+            planeU[y * CAPTURE_WIDTH / 2 + x] = U[i];
+            planeV[y * CAPTURE_WIDTH / 2 + x] = V[i];
+        }
+    }
+}
+
+static void y4mWriteFrame(void)
+{
+    fputs("FRAME\n", video);
+    fwrite(yuv, sizeof(yuv), 1, video);
+}
+
+static void y4mFrame(const uint8_t* framebuff, uint32_t skip)
+{
+    /* Frames lost to a full queue are filled in with the previous frame */
+    while (haveLast && skip--) {
+        y4mWriteFrame();
+    }
+
+    if (!haveLast || memcmp(last, framebuff, FRAMEBUFF_SIZE) != 0) {
+        y4mConvert(framebuff);
+        memcpy(last, framebuff, FRAMEBUFF_SIZE);
+        haveLast = true;
+    }
+    y4mWriteFrame();
+}
+
+/* ---- GIF ---------------------------------------------------------------- */
+
+typedef struct {
+    uint8_t     block[255];
+    int32_t     blockLen;
+    uint32_t    bits;
+    int32_t     bitCount;
+} GifWriter;
+
+static void gifPutByte(GifWriter* w, uint8_t byte)
+{
+    w->block[w->blockLen++] = byte;
+    if (w->blockLen == 255) {
+        fputc(255, video);
+        fwrite(w->block, 255, 1, video);
+        w->blockLen = 0;
+    }
+}
+
+static void gifPutCode(GifWriter* w, uint32_t code, int32_t width)
+{
+    w->bits |= code << w->bitCount;
+    w->bitCount += width;
+    while (w->bitCount >= 8) {
+        gifPutByte(w, w->bits & 0xFF);
+        w->bits >>= 8;
+        w->bitCount -= 8;
+    }
+}
+
+/* LZW with a two colour alphabet: min code size 2, clear = 4, end = 5 */
+static void gifCompress(const uint8_t* pixels, int32_t count)
+{
+    static uint16_t child[GIF_MAX_CODES][2];
+    GifWriter w = { {0}, 0, 0, 0 };
+    uint32_t prefix, next = 6;
+    int32_t i, width = 3;
+
+    fputc(2, video);
+    memset(child, 0, sizeof(child));
+    gifPutCode(&w, 4, width);
+
+    prefix = pixels[0];
+    for (i = 1; i < count; i++) {
+        uint8_t c = pixels[i];
+        if (child[prefix][c]) {
+            prefix = child[prefix][c];
+            continue;
+        }
+
+        gifPutCode(&w, prefix, width);
+        if (next < GIF_MAX_CODES) {
+            child[prefix][c] = next++;
+            if (next - 1 == (1u << width) && width < 12) {
+                width++;
+            }
+        } else {
+            gifPutCode(&w, 4, width);
+            memset(child, 0, sizeof(child));
+            next = 6;
+            width = 3;
+        }
+        prefix = c;
+    }
+    gifPutCode(&w, prefix, width);
+    gifPutCode(&w, 5, width);
+
+    if (w.bitCount > 0) {
+        gifPutByte(&w, w.bits & 0xFF);
+    }
+    if (w.blockLen > 0) {
+        fputc(w.blockLen, video);
+        fwrite(w.block, w.blockLen, 1, video);
+    }
+    fputc(0, video);
+}
+
+static uint32_t gifDelay(uint32_t frames)
+{
+    /* Centiseconds covered by the next frames, without accumulating drift */
+    uint64_t start = framesWritten * FRAME_TIME_MS / 10;
+    uint64_t end = (framesWritten + frames) * FRAME_TIME_MS / 10;
+    return (uint32_t)(end - start);
+}
+
+static void gifHeader(void)
+{
+    palette_t pal = filterGetPalette();
+
+    fwrite("GIF89a", 6, 1, video);
+    putLE16(video, CAPTURE_WIDTH);
+    putLE16(video, CAPTURE_HEIGHT);
+    fputc(0x80, video);     /* global colour table of 2 entries */
+    fputc(0, video);
+    fputc(0, video);
+    for (int32_t i = 0; i < 2; i++) {
+        uint32_t color = i ? pal.fg : pal.bg;
+        fputc((color >> 16) & 0xFF, video);
+        fputc((color >> 8) & 0xFF, video);
+        fputc(color & 0xFF, video);
+    }
+
+    /* Loop forever */
+    fwrite("\x21\xFF\x0BNETSCAPE2.0\x03\x01\x00\x00\x00", 19, 1, video);
+}
+
+static void gifFlush(void)
+{
+    uint32_t delay;
+
+    if (!haveLast || pendingFrames == 0) {
+        return;
+    }
+
+    delay = gifDelay(pendingFrames);
+    if (delay > 0xFFFF) {
+        delay = 0xFFFF;
+    }
+
+    fwrite("\x21\xF9\x04\x00", 4, 1, video);
+    putLE16(video, delay);
+    fputc(0, video);
+    fputc(0, video);
+
+    fputc(0x2C, video);
+    putLE16(video, 0);
+    putLE16(video, 0);
+    putLE16(video, CAPTURE_WIDTH);
+    putLE16(video, CAPTURE_HEIGHT);
+    fputc(0, video);
+
+    captureScale(last);
+    gifCompress(scaled, CAPTURE_WIDTH * CAPTURE_HEIGHT);
+
+    framesWritten += pendingFrames;
+    pendingFrames = 0;
+}
+
+static void gifFrame(const uint8_t* framebuff, uint32_t skip)
+{
+    pendingFrames += skip;
+
+    if (haveLast && memcmp(last, framebuff, FRAMEBUFF_SIZE) == 0) {
+        pendingFrames++;
+        return;
+    }
+
+    /*
+     * Most viewers clamp delays below 2cs, so a changed frame that would be
+     * shown for less than that replaces the pending one and takes its time.
+     */
+    if (gifDelay(pendingFrames) >= 2) {
+        gifFlush();
+    }
+    memcpy(last, framebuff, FRAMEBUFF_SIZE);
+    haveLast = true;
+    pendingFrames++;
+}
+
+/* ---- PNG ---------------------------------------------------------------- */
+
+static uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t len)
+{
+    size_t i;
+
+    if (crcTable[1] == 0) {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int32_t k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            }
+            crcTable[n] = c;
+        }
+    }
+
+    crc = ~crc;
+    for (i = 0; i < len; i++) {
+        crc = crcTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void pngChunk(FILE* fp, const char* type, const uint8_t* data, uint32_t len)
+{
+    uint32_t crc = crc32Update(0, (const uint8_t*)type, 4);
+    crc = crc32Update(crc, data, len);
+
+    putBE32(fp, len);
+    fwrite(type, 4, 1, fp);
+    fwrite(data, len, 1, fp);
+    putBE32(fp, crc);
+}
+
+int32_t captureWritePNG(const char* file, const uint8_t* framebuff)
+{
+    /* One filter byte per row, one palette index per pixel */
+    enum { ROW = CAPTURE_WIDTH + 1, RAW = ROW * CAPTURE_HEIGHT };
+    static uint8_t raw[RAW];
+    /* zlib header, stored deflate blocks of up to 65535 bytes, adler32 */
+    static uint8_t zdata[2 + RAW + 5 * (RAW / 65535 + 1) + 4];
+    palette_t pal = filterGetPalette();
+    uint8_t ihdr[13], plte[6];
+    uint32_t a = 1, b = 0;
+    int32_t i, y, len = 0;
+    FILE* fp;
+
+    captureScale(framebuff);
+    for (y = 0; y < CAPTURE_HEIGHT; y++) {
+        raw[y * ROW] = 0;
+        memcpy(&raw[y * ROW + 1], &scaled[y * CAPTURE_WIDTH], CAPTURE_WIDTH);
+    }
+
+    zdata[len++] = 0x78;
+    zdata[len++] = 0x01;
+    for (i = 0; i < RAW; ) {
+        int32_t n = (RAW - i > 65535) ? 65535 : RAW - i;
+        zdata[len++] = (i + n == RAW) ? 1 : 0;
+        zdata[len++] = n & 0xFF;
+        zdata[len++] = (n >> 8) & 0xFF;
+        zdata[len++] = ~n & 0xFF;
+        zdata[len++] = (~n >> 8) & 0xFF;
+        memcpy(&zdata[len], &raw[i], n);
+        len += n;
+        i += n;
+    }
+    for (i = 0; i < RAW; i++) {
+        a = (a + raw[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    zdata[len++] = (b >> 8) & 0xFF;
+    zdata[len++] = b & 0xFF;
+    zdata[len++] = (a >> 8) & 0xFF;
+    zdata[len++] = a & 0xFF;
+
+    ihdr[0] = 0; ihdr[1] = 0; ihdr[2] = (CAPTURE_WIDTH >> 8) & 0xFF; ihdr[3] = CAPTURE_WIDTH & 0xFF;
+    ihdr[4] = 0; ihdr[5] = 0; ihdr[6] = (CAPTURE_HEIGHT >> 8) & 0xFF; ihdr[7] = CAPTURE_HEIGHT & 0xFF;
+    ihdr[8] = 8;        /* bit depth */
+    ihdr[9] = 3;        /* indexed colour */
+    ihdr[10] = 0;
+    ihdr[11] = 0;
+    ihdr[12] = 0;
+    for (i = 0; i < 2; i++) {
+        uint32_t color = i ? pal.fg : pal.bg;
+        plte[3 * i]     = (color >> 16) & 0xFF;
+        plte[3 * i + 1] = (color >> 8) & 0xFF;
+        plte[3 * i + 2] = color & 0xFF;
+    }
+
+    fp = fopen(file, "wb");
+    if (fp == NULL) {
+        fprintf(stderr, "Error opening capture file: %s\n", file);
+        return -1;
+    }
+    fwrite("\x89PNG\r\n\x1A\n", 8, 1, fp);
+    pngChunk(fp, "IHDR", ihdr, sizeof(ihdr));
+    pngChunk(fp, "PLTE", plte, sizeof(plte));
+    pngChunk(fp, "IDAT", zdata, len);
+    pngChunk(fp, "IEND", NULL, 0);
+    fclose(fp);
+    return 0;
+}
+
+/* ---- Encoder thread ----------------------------------------------------- */
+
+static void captureSaveScreenshot(const uint8_t* framebuff)
+{
+    char name[32];
+    FILE* fp;
+
+    /* Pick the first screenshot-NNNN.png that does not exist yet */
+    do {
+        snprintf(name, sizeof(name), "screenshot-%04u.png", screenshots++);
+        fp = fopen(name, "rb");
+        if (fp != NULL) {
+            fclose(fp);
+        }
+    } while (fp != NULL);
+
+    if (captureWritePNG(name, framebuff) == 0) {
+        printf("Saved %s\n", name);
+    }
+}
+
+static int captureThread(void* data)
+{
+    uint32_t t;
+    CaptureSlot* slot;
+    (void)data;
+
+    for (;;) {
+        SDL_SemWait(ready);
+
+        t = (uint32_t)SDL_AtomicGet(&tail);
+        if (t == (uint32_t)SDL_AtomicGet(&head)) {
+            if (!SDL_AtomicGet(&running)) {
+                break;
+            }
+            continue;
+        }
+
+        slot = &pool[t % CAPTURE_POOL_SIZE];
+        if (slot->type == CAPTURE_SCREENSHOT) {
+            captureSaveScreenshot(slot->framebuff);
+        } else if (format == FORMAT_GIF) {
+            gifFrame(slot->framebuff, slot->skipped);
+        } else {
+            y4mFrame(slot->framebuff, slot->skipped);
+        }
+        SDL_AtomicSet(&tail, t + 1);
+    }
+    return 0;
+}
+
+int32_t captureInit(const char* file)
+{
+    const char* ext;
+
+    if (file != NULL) {
+        ext = strrchr(file, '.');
+        if (ext != NULL && strcmp(ext, ".gif") == 0) {
+            format = FORMAT_GIF;
+        } else if (ext != NULL && strcmp(ext, ".y4m") == 0) {
+            format = FORMAT_Y4M;
+        } else {
+            fprintf(stderr, "Capture file must end in .y4m or .gif: %s\n", file);
+            return -1;
+        }
+
+        video = fopen(file, "wb");
+        if (video == NULL) {
+            fprintf(stderr, "Error opening capture file: %s\n", file);
+            return -1;
+        }
+
+        if (format == FORMAT_GIF) {
+            gifHeader();
+        } else {
+            /* Frames are presented every FRAME_TIME_MS, not at exactly 60 Hz */
+            fprintf(video, "YUV4MPEG2 W%d H%d F1000:%d Ip A1:1 C420jpeg\n",
+                    CAPTURE_WIDTH, CAPTURE_HEIGHT, FRAME_TIME_MS);
+        }
+    }
+
+    SDL_AtomicSet(&head, 0);
+    SDL_AtomicSet(&tail, 0);
+    SDL_AtomicSet(&running, 1);
+
+    ready = SDL_CreateSemaphore(0);
+    thread = SDL_CreateThread(captureThread, "capture", NULL);
+    if (ready == NULL || thread == NULL) {
+        fprintf(stderr, "Could not start capture thread: %s\n", SDL_GetError());
+        return -1;
+    }
+    return 0;
+}
+
+void captureExit(void)
+{
+    if (thread == NULL) {
+        return;
+    }
+
+    SDL_AtomicSet(&running, 0);
+    SDL_SemPost(ready);
+    SDL_WaitThread(thread, NULL);
+    thread = NULL;
+    SDL_DestroySemaphore(ready);
+    ready = NULL;
+
+    /* The encoder has stopped, so frames dropped at the end are added here */
+    if (video != NULL) {
+        if (format == FORMAT_GIF) {
+            if (haveLast) {
+                pendingFrames += skipped;
+            }
+            gifFlush();
+            fputc(0x3B, video);
+        } else {
+            for (; haveLast && skipped > 0; skipped--) {
+                y4mWriteFrame();
+            }
+        }
+        skipped = 0;
+        fclose(video);
+        video = NULL;
+    }
+
+    if (dropped) {
+        fprintf(stderr, "Capture dropped %u frames.\n", dropped);
+    }
+}
+
+static void captureQueue(uint8_t type, const uint8_t* framebuff)
+{
+    uint32_t h = (uint32_t)SDL_AtomicGet(&head);
+    CaptureSlot* slot;
+
+    if (thread == NULL) {
+        return;
+    }
+
+    if (h - (uint32_t)SDL_AtomicGet(&tail) >= CAPTURE_POOL_SIZE) {
+        if (type == CAPTURE_VIDEO) {
+            skipped++;
+            dropped++;
+        } else {
+            fprintf(stderr, "Capture queue full, screenshot dropped.\n");
+        }
+        return;
+    }
+
+    slot = &pool[h % CAPTURE_POOL_SIZE];
+    slot->type = type;
+    slot->skipped = 0;
+    if (type == CAPTURE_VIDEO) {
+        slot->skipped = skipped;
+        skipped = 0;
+    }
+    memcpy(slot->framebuff, framebuff, FRAMEBUFF_SIZE);
+
+    SDL_AtomicSet(&head, h + 1);
+    SDL_SemPost(ready);
+}
+
+void captureFrame(const uint8_t* framebuff)
+{
+    if (video != NULL) {
+        captureQueue(CAPTURE_VIDEO, framebuff);
+    }
+}
+
+void captureScreenshot(const uint8_t* framebuff)
+{
+    captureQueue(CAPTURE_SCREENSHOT, framebuff);
+}
@@ -0,0 +1,18 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+#include "chip8.h"
+
+#define CAPTURE_POOL_SIZE   64
+#define CAPTURE_SCALE       4
+#define CAPTURE_WIDTH       (SCREEN_WIDTH * CAPTURE_SCALE)
+#define CAPTURE_HEIGHT      (SCREEN_HEIGHT * CAPTURE_SCALE)
+
+int32_t captureInit(const char* file);
+void captureExit(void);
+void captureFrame(const uint8_t* framebuff);
+void captureScreenshot(const uint8_t* framebuff);
+int32_t captureWritePNG(const char* file, const uint8_t* framebuff);
+
+#endif
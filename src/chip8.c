@@ -3,71 +3,74 @@
 #include <stdio.h>
 #include <SDL2/SDL.h>
 #include "chip8.h"
-
-#define FRAME_RATE              60
-#define FRAME_TIME_MS           (1000 / FRAME_RATE)
-#define CPU_FREQUENCY           600
-#define CYCLES_PER_FRAME_TIME   (CPU_FREQUENCY / FRAME_RATE)
+#include "capture.h"
+#include "input.h"
+#include "recomp.h"
 
 static SDL_Window* window = NULL;
 static SDL_Renderer* renderer = NULL;
 static SDL_Texture* texture = NULL;
-static const uint8_t* keyStates = NULL;
-
-const uint8_t KeyBindings[16] = {
-    SDL_SCANCODE_X,
-    SDL_SCANCODE_1,
-    SDL_SCANCODE_2,
-    SDL_SCANCODE_3,
-    SDL_SCANCODE_Q,
-    SDL_SCANCODE_W,
-    SDL_SCANCODE_E,
-    SDL_SCANCODE_A,
-    SDL_SCANCODE_S,
-    SDL_SCANCODE_D,
-    SDL_SCANCODE_Z,
-    SDL_SCANCODE_C,
-    SDL_SCANCODE_4,
-    SDL_SCANCODE_R,
-    SDL_SCANCODE_F,
-    SDL_SCANCODE_V
-};
-
-void chip8Init(Chip8CPU* cpu)
+
+static filter_t filter = FILTER_NEAREST;
+static uint32_t pixels[FILTER_MAXSIZE];
+static uint32_t cycleCount = 0;
+
+void chip8Init(Chip8CPU* cpu, const Chip8Config* config)
 {
+    int32_t width, height, scale;
+
     cpuInit(cpu);
     SDL_Init(SDL_INIT_VIDEO);
 
+    filter = config->filter;
+    width  = SCREEN_WIDTH * filterScale(filter);
+    height = SCREEN_HEIGHT * filterScale(filter);
+    scale  = WINDOW_WIDTH / width;
+
     window = SDL_CreateWindow("Chip8 Emulator",
                                SDL_WINDOWPOS_CENTERED,
                                SDL_WINDOWPOS_CENTERED,
-                               WINDOW_WIDTH,
-                               WINDOW_HEIGHT,
-                               SDL_WINDOW_SHOWN);
+                               width * scale,
+                               height * scale,
+                               SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
     if (window == NULL) {
         fprintf(stderr, "Could not create window: %s\n", SDL_GetError());
         exit(1);
     }
+    SDL_SetWindowMinimumSize(window, width, height);
 
     renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
     if (renderer == NULL) {
         fprintf(stderr, "Could not create renderer: %s\n", SDL_GetError());
     }
 
+    /* Letterbox to the largest whole multiple of the filter output */
+    SDL_RenderSetLogicalSize(renderer, width, height);
+    SDL_RenderSetIntegerScale(renderer, SDL_TRUE);
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "nearest");
+
     texture = SDL_CreateTexture(renderer,
                                 SDL_PIXELFORMAT_ARGB8888,
                                 SDL_TEXTUREACCESS_STREAMING,
-                                SCREEN_WIDTH,
-                                SCREEN_HEIGHT);
+                                width,
+                                height);
     if (texture == NULL) {
         fprintf(stderr, "Could not create texture: %s\n", SDL_GetError());
     }
 
-    keyStates = SDL_GetKeyboardState(NULL);
+    inputInit(INPUT_QUEUED, config->latency);
+
+    if (captureInit(config->record) != 0) {
+        exit(1);
+    }
 }
 
 void chip8Exit(Chip8CPU* cpu)
 {
+    captureExit();
+    inputExit();
+    recompUnload();
+
     SDL_DestroyTexture(texture);
     texture = NULL;
     SDL_DestroyRenderer(renderer);
@@ -86,7 +89,7 @@ int32_t chip8LoadROM(Chip8CPU* cpu, const char* file)
     FILE* fp = fopen(file, "rb");
     if (fp == NULL) {
         fprintf(stderr, "Error opening ROM file: %s\n", file);
-        return 1;
+        return -1;
     }
 
     fseek(fp, 0, SEEK_END);
@@ -95,6 +98,7 @@ int32_t chip8LoadROM(Chip8CPU* cpu, const char* file)
 
     if (filesize > ROM_MAXSIZE) {
         fprintf(stderr, "ROM file exceeds maximum allowable size.\n");
+        fclose(fp);
         return -1;
     }
 
@@ -103,51 +107,90 @@ int32_t chip8LoadROM(Chip8CPU* cpu, const char* file)
     return filesize;
 }
 
+/* Runs count cycles, stopping wherever a held-back key change falls due */
+static void chip8Run(Chip8CPU* cpu, int32_t count)
+{
+    int32_t n;
+
+    while (count > 0) {
+        n = inputApply(cpu, cycleCount);
+        if (n > count) {
+            n = count;
+        }
+        recompRun(cpu, n);
+        cycleCount += n;
+        count -= n;
+    }
+}
+
+/*
+ * The frame's cycles are spread over its wall time: the loop sleeps in the
+ * event wait, and before handling an event it catches the CPU up to the
+ * cycle matching the event's arrival.  Whatever is left runs at the end of
+ * the frame, just before it is drawn.
+ */
 void chip8Execute(Chip8CPU* cpu)
 {
-    int32_t i, t0, elapsed;
+    uint32_t frameStart;
+    int32_t done, due, remaining;
     bool exit = false;
     SDL_Event event;
 
+    frameStart = SDL_GetTicks();
     while (!exit) {
 
-        t0 = SDL_GetTicks();
+        done = 0;
+        for (;;) {
+            remaining = (int32_t)(frameStart + FRAME_TIME_MS - SDL_GetTicks());
+            if (remaining > 0 ? !SDL_WaitEventTimeout(&event, remaining) : !SDL_PollEvent(&event)) {
+                break;
+            }
 
-        while (SDL_PollEvent(&event)) {
-            if (event.type == SDL_QUIT || keyStates[SDL_SCANCODE_ESCAPE]) {
-                exit = true;
+            due = (int32_t)(event.common.timestamp - frameStart) * CYCLES_PER_FRAME_TIME / FRAME_TIME_MS;
+            if (due > CYCLES_PER_FRAME_TIME) {
+                due = CYCLES_PER_FRAME_TIME;
+            }
+            if (due > done) {
+                chip8Run(cpu, due - done);
+                done = due;
             }
-        }
-        for (i = 0; i < KEY_SIZE; i++) {
-            cpu->key[i] = keyStates[ KeyBindings[i] ];
-        }
 
-        for (i = 0; i < CYCLES_PER_FRAME_TIME; i++) {
-            cpuExecute(cpu);
+            if (event.type == SDL_QUIT ||
+                (event.type == SDL_KEYDOWN && event.key.keysym.scancode == SDL_SCANCODE_ESCAPE)) {
+                exit = true;
+            }
+            if (event.type == SDL_KEYDOWN && event.key.keysym.scancode == SDL_SCANCODE_F12) {
+                captureScreenshot(cpu->framebuff);
+            }
+            inputHandleEvent(&event);
         }
 
+        chip8Run(cpu, CYCLES_PER_FRAME_TIME - done);
         chip8DrawScreen(cpu);
         cpuUpdateTimers(cpu);
 
-        elapsed = SDL_GetTicks() - t0;
-        if (elapsed < FRAME_TIME_MS) {
-            SDL_Delay(FRAME_TIME_MS - elapsed);
+        /* Drop the lost time rather than racing to catch up after a stall */
+        frameStart += FRAME_TIME_MS;
+        if ((int32_t)(SDL_GetTicks() - frameStart) > FRAME_TIME_MS) {
+            frameStart = SDL_GetTicks();
         }
     }
 }
 
 void chip8DrawScreen(Chip8CPU* cpu) {
-    int32_t i;
-    uint32_t pixels[FRAMEBUFF_SIZE];
-    for (i = 0; i < FRAMEBUFF_SIZE; i++) {
-        pixels[i] = (cpu->framebuff[i] * 0x00FFFFFF);
+    /* Only re-filter and upload frames where CLS or DRW touched the screen */
+    if (cpu->dirty) {
+        filterApply(filter, cpu->framebuff, pixels);
+        SDL_UpdateTexture(texture, NULL, pixels,
+                          SCREEN_WIDTH * filterScale(filter) * sizeof(uint32_t));
+        cpu->dirty = 0;
     }
-
-    SDL_UpdateTexture(texture, NULL, pixels, SCREEN_WIDTH * sizeof(uint32_t));
+    captureFrame(cpu->framebuff);
 
     SDL_RenderClear(renderer);
     SDL_RenderCopy(renderer, texture, NULL, NULL);
     SDL_RenderPresent(renderer);
+    inputPresented(cycleCount);
 }
 
 void chip8PrintROMDisassembly(Chip8CPU* cpu, const char* file)
@@ -1,9 +1,22 @@
 #ifndef CHIP8_H
 #define CHIP8_H
 
+#include <stdbool.h>
 #include "cpu.h"
+#include "filter.h"
 
-void chip8Init(Chip8CPU* cpu);
+#define FRAME_RATE              60
+#define FRAME_TIME_MS           (1000 / FRAME_RATE)
+#define CPU_FREQUENCY           600
+#define CYCLES_PER_FRAME_TIME   (CPU_FREQUENCY / FRAME_RATE)
+
+typedef struct {
+    filter_t    filter;
+    const char* record;
+    bool        latency;
+} Chip8Config;
+
+void chip8Init(Chip8CPU* cpu, const Chip8Config* config);
 void chip8Exit(Chip8CPU* cpu);
 int32_t chip8LoadROM(Chip8CPU* cpu, const char* file);
 void chip8Execute(Chip8CPU* cpu);
@@ -6,12 +6,6 @@
 #define LOWER_BYTE(opcode)  (opcode & 0x00FF)
 #define UPPER_BYTE(opcode)  ((opcode >> 8) & 0x00FF)
 
-#define OP_NNN(opcode)  (opcode & 0x0FFF)
-#define OP_N(opcode)    (opcode & 0x000F)
-#define OP_X(opcode)    ((opcode >> 8) & 0x0F)
-#define OP_Y(opcode)    ((opcode >> 4) & 0x0F)
-#define OP_KK(opcode)   (opcode & 0x00FF)
-
 static const uint8_t Chip8Font[80] =
 {
     0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
@@ -36,6 +30,7 @@ void cpuInit(Chip8CPU* cpu)
 {
     memset(cpu, 0, sizeof(Chip8CPU));
     cpu->PC = ROM_START;
+    cpu->dirty = 1;
     memcpy(cpu->ram, Chip8Font, sizeof(Chip8Font));
 }
 
@@ -60,9 +55,6 @@ void cpuExecute(Chip8CPU* cpu)
     uint8_t  y      = OP_Y(opcode);
     uint8_t  byte   = OP_KK(opcode);
 
-    int32_t xx, yy, idx;
-    uint8_t spriteByte, pixel;
-
     switch (opcode & 0xF000) {
         case 0x0000:
             switch (opcode) {
@@ -74,6 +66,7 @@ void cpuExecute(Chip8CPU* cpu)
                 /* 00E0 - CLS */
                 case 0x00E0:
                     memset(cpu->framebuff, 0, FRAMEBUFF_SIZE);
+                    cpu->dirty = 1;
                     cpu->PC += 2;
                     break;
 
@@ -231,22 +224,7 @@ void cpuExecute(Chip8CPU* cpu)
 
         /* Dxyn - DRW Vx, Vy, nibble */
         case 0xD000:
-            cpu->V[0xF] = 0;
-            yy = cpu->V[y] % SCREEN_HEIGHT;
-            for (int32_t row = 0; row < nibble; row++) {
-                xx = cpu->V[x] % SCREEN_WIDTH;
-                spriteByte = cpu->ram[ cpu->I + row ];
-                for (int32_t col = 0; col < 8; col++) {
-                    pixel = (spriteByte >> (7 - col)) & 0x01;
-                    idx = yy * SCREEN_WIDTH + xx;
-                    if (cpu->framebuff[idx] && pixel) {
-                        cpu->V[0xF] = 1;
-                    }
-                    cpu->framebuff[idx] ^= pixel;
-                    xx = (xx + 1) % SCREEN_WIDTH;
-                }
-                yy = (yy + 1) % SCREEN_HEIGHT;
-            }
+            cpuDrawSprite(cpu, x, y, nibble);
             cpu->PC += 2;
             break;
 
@@ -322,6 +300,7 @@ void cpuExecute(Chip8CPU* cpu)
                     cpu->ram[cpu->I]        = (cpu->V[x] / 100);
                     cpu->ram[cpu->I + 1]    = (cpu->V[x] / 10) % 10;
                     cpu->ram[cpu->I + 2]    = (cpu->V[x] % 10);
+                    CPU_MARK_WRITTEN(cpu, cpu->I, 3);
                     cpu->PC += 2;
                     break;
 
@@ -330,6 +309,7 @@ void cpuExecute(Chip8CPU* cpu)
                     for (int32_t i = 0; i <= x; i++) {
                         cpu->ram[cpu->I + i] = cpu->V[i];
                     }
+                    CPU_MARK_WRITTEN(cpu, cpu->I, x + 1);
                     cpu->PC += 2;
                     break;
 
@@ -354,163 +334,159 @@ void cpuExecute(Chip8CPU* cpu)
     }
 }
 
-int32_t cpuDisassemble(Chip8CPU* cpu)
+void cpuDisassembleOpcode(uint16_t opcode, char* buf, size_t size)
 {
-    uint16_t opcode;
-    opcode = (cpu->ram[cpu->PC] << 8) | (cpu->ram[cpu->PC+1]);
-    printf("0x%04x %02x %02x\t", cpu->PC, LOWER_BYTE(opcode), UPPER_BYTE(opcode));
-
     switch (opcode & 0xF000) {
         case 0x0000:
             switch (opcode) {
                 /* 0nnn - SYS addr */
                 case 0x0000:
-                    printf("SYS 0x%04x\n", opcode);
+                    snprintf(buf, size, "SYS 0x%04x", opcode);
                     break;
 
                 /* 00E0 - CLS */
                 case 0x00E0:
-                    printf("CLS\n");
+                    snprintf(buf, size, "CLS");
                     break;
 
                 /* 00EE - RET */
                 case 0x00EE:
-                    printf("RET\n");
+                    snprintf(buf, size, "RET");
                     break;
 
                 default:
-                    printf("INSTRUCTION UNKNOWN\n");
+                    snprintf(buf, size, "INSTRUCTION UNKNOWN");
                     break;
             }
             break;
 
         /* 1nnn - JP addr */
         case 0x1000:
-            printf("JP 0x%04x\n", OP_NNN(opcode));
+            snprintf(buf, size, "JP 0x%04x", OP_NNN(opcode));
             break;
 
         /* 2nnn - CALL addr */
         case 0x2000:
-            printf("CALL 0x%04x\n", OP_NNN(opcode));
+            snprintf(buf, size, "CALL 0x%04x", OP_NNN(opcode));
             break;
 
         /* 3xkk - SE Vx, byte */
         case 0x3000:
-            printf("SE V%x, #%02x\n", OP_X(opcode), OP_KK(opcode));
+            snprintf(buf, size, "SE V%x, #%02x", OP_X(opcode), OP_KK(opcode));
             break;
 
         /* 4xkk - SNE Vx, byte */
         case 0x4000:
-            printf("SNE V%x, #%02x\n", OP_X(opcode), OP_KK(opcode));
+            snprintf(buf, size, "SNE V%x, #%02x", OP_X(opcode), OP_KK(opcode));
             break;
 
         /* 5xy0 - SE Vx, Vy */
         case 0x5000:
-            printf("SE V%x, V%x\n", OP_X(opcode), OP_Y(opcode));
+            snprintf(buf, size, "SE V%x, V%x", OP_X(opcode), OP_Y(opcode));
             break;
 
         /* 6xkk - LD Vx, byte */
         case 0x6000:
-            printf("LD V%x, #%02x\n", OP_X(opcode), OP_KK(opcode));
+            snprintf(buf, size, "LD V%x, #%02x", OP_X(opcode), OP_KK(opcode));
             break;
 
         /* 7xkk - ADD Vx, byte */
         case 0x7000:
-            printf("ADD V%x, #%02x\n", OP_X(opcode), OP_KK(opcode));
+            snprintf(buf, size, "ADD V%x, #%02x", OP_X(opcode), OP_KK(opcode));
             break;
 
         case 0x8000:
             switch (opcode & 0x000F) {
                 /* 8xy0 - LD Vx, Vy */
                 case 0x0000:
-                    printf("LD V%x, V%x\n", OP_X(opcode), OP_Y(opcode));
+                    snprintf(buf, size, "LD V%x, V%x", OP_X(opcode), OP_Y(opcode));
                     break;
 
                 /* 8xy1 - OR Vx, Vy */
                 case 0x0001:
-                    printf("OR V%x, V%x\n", OP_X(opcode), OP_Y(opcode));
+                    snprintf(buf, size, "OR V%x, V%x", OP_X(opcode), OP_Y(opcode));
                     break;
 
                 /* 8xy2 - AND Vx, Vy */
                 case 0x0002:
-                    printf("AND V%x, V%x\n", OP_X(opcode), OP_Y(opcode));
+                    snprintf(buf, size, "AND V%x, V%x", OP_X(opcode), OP_Y(opcode));
                     break;
 
                 /* 8xy3 - XOR Vx, Vy */
                 case 0x0003:
-                    printf("XOR V%x, V%x\n", OP_X(opcode), OP_Y(opcode));
+                    snprintf(buf, size, "XOR V%x, V%x", OP_X(opcode), OP_Y(opcode));
                     break;
 
                 /* 8xy4 - ADD Vx, Vy */
                 case 0x0004:
-                    printf("ADD V%x, V%x\n", OP_X(opcode), OP_Y(opcode));
+                    snprintf(buf, size, "ADD V%x, V%x", OP_X(opcode), OP_Y(opcode));
                     break;
 
                 /* 8xy5 - SUB Vx, Vy */
                 case 0x0005:
-                    printf("SUB V%x, V%x\n", OP_X(opcode), OP_Y(opcode));
+                    snprintf(buf, size, "SUB V%x, V%x", OP_X(opcode), OP_Y(opcode));
                     break;
 
                 /* 8xy6 - SHR Vx {, Vy} */
                 case 0x0006:
-                    printf("SHR V%x {, V%x}\n", OP_X(opcode), OP_Y(opcode));
+                    snprintf(buf, size, "SHR V%x {, V%x}", OP_X(opcode), OP_Y(opcode));
                     break;
 
                 /* 8xy7 - SUBN Vx, Vy */
                 case 0x0007:
-                    printf("SUBN V%x, V%x\n", OP_X(opcode), OP_Y(opcode));
+                    snprintf(buf, size, "SUBN V%x, V%x", OP_X(opcode), OP_Y(opcode));
                     break;
 
                 /* 8xyE - SHL Vx {, Vy} */
                 case 0x000E:
-                    printf("SHL V%x {, V%x}\n", OP_X(opcode), OP_Y(opcode));
+                    snprintf(buf, size, "SHL V%x {, V%x}", OP_X(opcode), OP_Y(opcode));
                     break;
 
                 default:
-                    printf("INSTRUCTION UNKNOWN\n");
+                    snprintf(buf, size, "INSTRUCTION UNKNOWN");
                     break;
             }
             break;
 
         /* 9xy0 - SNE Vx, Vy */
         case 0x9000:
-            printf("SNE V%x, V%x\n", OP_X(opcode), OP_Y(opcode));
+            snprintf(buf, size, "SNE V%x, V%x", OP_X(opcode), OP_Y(opcode));
             break;
 
         /* Annn - LD I, addr */
         case 0xA000:
-            printf("LD I, 0x%04x\n", OP_NNN(opcode));
+            snprintf(buf, size, "LD I, 0x%04x", OP_NNN(opcode));
             break;
 
         /* Bnnn - JP V0, addr */
         case 0xB000:
-            printf("JP V0, 0x%04x\n", OP_NNN(opcode));
+            snprintf(buf, size, "JP V0, 0x%04x", OP_NNN(opcode));
             break;
 
         /* Cxkk - RND Vx, byte */
         case 0xC000:
-            printf("RND V%x, #%x\n", OP_X(opcode), OP_KK(opcode));
+            snprintf(buf, size, "RND V%x, #%x", OP_X(opcode), OP_KK(opcode));
             break;
 
         /* Dxyn - DRW Vx, Vy, nibble */
         case 0xD000:
-            printf("DRW V%x, V%x, %x\n", OP_X(opcode), OP_Y(opcode), OP_N(opcode));
+            snprintf(buf, size, "DRW V%x, V%x, %x", OP_X(opcode), OP_Y(opcode), OP_N(opcode));
             break;
 
         case 0xE000:
             switch (opcode & 0x00FF) {
                 /* Ex9E - SKP Vx */
                 case 0x009E:
-                    printf("SKP V%x\n", OP_X(opcode));
+                    snprintf(buf, size, "SKP V%x", OP_X(opcode));
                     break;
 
                 /* ExA1 - SKNP Vx */
                 case 0x00A1:
-                    printf("SKNP V%x\n", OP_X(opcode));
+                    snprintf(buf, size, "SKNP V%x", OP_X(opcode));
                     break;
 
                 default:
-                    printf("INSTRUCTION UNKNOWN\n");
+                    snprintf(buf, size, "INSTRUCTION UNKNOWN");
                     break;
             }
             break;
@@ -519,58 +495,68 @@ int32_t cpuDisassemble(Chip8CPU* cpu)
             switch (opcode & 0x00FF) {
                 /* Fx07 - LD Vx, DT */
                 case 0x0007:
-                    printf("LD V%x, DT\n", OP_X(opcode));
+                    snprintf(buf, size, "LD V%x, DT", OP_X(opcode));
                     break;
 
                 /* Fx0A - LD Vx, K */
                 case 0x000A:
-                    printf("LD V%x, K\n", OP_X(opcode));
+                    snprintf(buf, size, "LD V%x, K", OP_X(opcode));
                     break;
 
                 /* Fx15 - LD DT, Vx */
                 case 0x0015:
-                    printf("LD DT, V%x\n", OP_X(opcode));
+                    snprintf(buf, size, "LD DT, V%x", OP_X(opcode));
                     break;
 
                 /* Fx18 - LD ST, Vx */
                 case 0x0018:
-                    printf("LD ST, V%x\n", OP_X(opcode));
+                    snprintf(buf, size, "LD ST, V%x", OP_X(opcode));
                     break;
 
                 /* Fx1E - ADD I, Vx */
                 case 0x001E:
-                    printf("ADD I, V%x\n", OP_X(opcode));
+                    snprintf(buf, size, "ADD I, V%x", OP_X(opcode));
                     break;
 
                 /* Fx29 - LD F, Vx */
                 case 0x0029:
-                    printf("LD F, V%x\n", OP_X(opcode));
+                    snprintf(buf, size, "LD F, V%x", OP_X(opcode));
                     break;
 
                 /* Fx33 - LD B, Vx */
                 case 0x0033:
-                    printf("LD B, V%x\n", OP_X(opcode));
+                    snprintf(buf, size, "LD B, V%x", OP_X(opcode));
                     break;
 
                 /* Fx55 - LD [I], Vx */
                 case 0x0055:
-                    printf("LD [I], V%x\n", OP_X(opcode));
+                    snprintf(buf, size, "LD [I], V%x", OP_X(opcode));
                     break;
 
                 /* Fx65 - LD Vx, [I] */
                 case 0x0065:
-                    printf("LD V%x, [I]\n", OP_X(opcode));
+                    snprintf(buf, size, "LD V%x, [I]", OP_X(opcode));
                     break;
 
                 default:
-                    printf("INSTRUCTION UNKNOWN\n");
+                    snprintf(buf, size, "INSTRUCTION UNKNOWN");
                     break;
             }
             break;
 
         default:
-            printf("INSTRUCTION UNKNOWN\n");
+            snprintf(buf, size, "INSTRUCTION UNKNOWN");
             break;
     }
+}
+
+int32_t cpuDisassemble(Chip8CPU* cpu)
+{
+    uint16_t opcode;
+    char text[32];
+
+    opcode = (cpu->ram[cpu->PC] << 8) | (cpu->ram[cpu->PC+1]);
+    cpuDisassembleOpcode(opcode, text, sizeof(text));
+    printf("0x%04x %02x %02x\t%s\n", cpu->PC, LOWER_BYTE(opcode), UPPER_BYTE(opcode), text);
     return 2;
 }
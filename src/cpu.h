@@ -1,6 +1,7 @@
 #ifndef CPU_H
 #define CPU_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #define RAM_SIZE        4096
@@ -15,20 +16,71 @@
 #define WINDOW_WIDTH    (SCREEN_WIDTH * 10)
 #define WINDOW_HEIGHT   (SCREEN_HEIGHT * 10)
 
+/* RAM is tracked in 256-byte pages so instances can share unwritten ones */
+#define CPU_ALIGN       64
+#define CPU_PAGE_SHIFT  8
+#define CPU_PAGE_SIZE   (1 << CPU_PAGE_SHIFT)
+#define CPU_PAGES       (RAM_SIZE / CPU_PAGE_SIZE)
+
+/*
+ * The registers nearly every instruction touches share the first cache
+ * line; ram starts on its own line.  Allocate with CPU_ALIGN alignment.
+ */
 typedef struct {
+    _Alignas(CPU_ALIGN)
     uint8_t     V[16];
-    uint8_t     DT;
-    uint8_t     ST;
     uint16_t    PC;
     uint16_t    I;
     uint8_t     SP;
-
+    uint8_t     DT;
+    uint8_t     ST;
+    uint8_t     dirty;
     uint16_t    stack[STACK_SIZE];
+    uint16_t    written;    /* one bit per RAM page stored to */
+    uint16_t    stale;      /* pages whose recompiled code no longer matches RAM */
+
+    _Alignas(CPU_ALIGN)
     uint8_t     ram[RAM_SIZE];
     uint8_t     framebuff[FRAMEBUFF_SIZE];
     uint8_t     key[KEY_SIZE];
 } Chip8CPU;
 
+/* Stores are at most 16 bytes, so they touch one page or two neighbours */
+#define CPU_MARK_WRITTEN(cpu, addr, len)                                    \
+    ((cpu)->written |= (1u << (((addr) >> CPU_PAGE_SHIFT) & (CPU_PAGES - 1))) |   \
+                       (1u << ((((addr) + (len) - 1) >> CPU_PAGE_SHIFT) & (CPU_PAGES - 1))))
+
+#define OP_NNN(opcode)  ((opcode) & 0x0FFF)
+#define OP_N(opcode)    ((opcode) & 0x000F)
+#define OP_X(opcode)    (((opcode) >> 8) & 0x0F)
+#define OP_Y(opcode)    (((opcode) >> 4) & 0x0F)
+#define OP_KK(opcode)   ((opcode) & 0x00FF)
+
+/* Dxyn - DRW Vx, Vy, nibble; shared with recompiled modules */
+static inline void cpuDrawSprite(Chip8CPU* cpu, uint8_t x, uint8_t y, uint8_t nibble)
+{
+    int32_t xx, yy, idx;
+    uint8_t spriteByte, pixel;
+
+    cpu->V[0xF] = 0;
+    yy = cpu->V[y] % SCREEN_HEIGHT;
+    for (int32_t row = 0; row < nibble; row++) {
+        xx = cpu->V[x] % SCREEN_WIDTH;
+        spriteByte = cpu->ram[ cpu->I + row ];
+        for (int32_t col = 0; col < 8; col++) {
+            pixel = (spriteByte >> (7 - col)) & 0x01;
+            idx = yy * SCREEN_WIDTH + xx;
+            if (cpu->framebuff[idx] && pixel) {
+                cpu->V[0xF] = 1;
+            }
+            cpu->framebuff[idx] ^= pixel;
+            xx = (xx + 1) % SCREEN_WIDTH;
+        }
+        yy = (yy + 1) % SCREEN_HEIGHT;
+    }
+    cpu->dirty = 1;
+}
+
 typedef union {
     uint16_t    instr;
     uint8_t     byte[2];
@@ -38,6 +90,7 @@ typedef union {
 void cpuInit(Chip8CPU* cpu);
 void cpuUpdateTimers(Chip8CPU* cpu);
 void cpuExecute(Chip8CPU* cpu);
+void cpuDisassembleOpcode(uint16_t opcode, char* buf, size_t size);
 int32_t cpuDisassemble(Chip8CPU* cpu);
 
 #endif
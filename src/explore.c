@@ -0,0 +1,578 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "chip8.h"
+#include "capture.h"
+#include "explore.h"
+#include "page.h"
+
+/*
+ * Breadth-first search over everything a ROM can do.  Every frame each
+ * state branches on the held key (none or 0-F) and, inside the frame, on
+ * the outcomes of RND.  States are deduplicated by a 64-bit hash built
+ * from cached page hashes, so a child only rehashes the pages its frame
+ * wrote.  Each level of the frontier is expanded by one worker per core.
+ *
+ * Output is one explore-NNNN.png per distinct screen and explore.txt
+ * listing the inputs that reach it.
+ */
+
+#define RAM_PAGES       (RAM_SIZE / PAGE_SIZE)
+#define FB_PAGES        (FRAMEBUFF_SIZE / PAGE_SIZE)
+#define STATE_PAGES     (RAM_PAGES + FB_PAGES)
+#define NO_KEY          KEY_SIZE
+
+typedef struct {
+    uint8_t     key;
+    uint8_t     rndCount;
+    uint8_t     rnd[EXPLORE_FRAME_RANDOMS];
+} ExplorePath;
+
+typedef struct {
+    int32_t     parent;
+    ExplorePath path;
+} ExploreNode;
+
+/* A machine between frames; key state is not kept since every frame sets it */
+typedef struct {
+    uint8_t     V[16];
+    uint8_t     DT;
+    uint8_t     ST;
+    uint16_t    PC;
+    uint16_t    I;
+    uint8_t     SP;
+    uint16_t    stack[STACK_SIZE];
+    Page*       pages[STATE_PAGES];
+    int32_t     node;
+} ExploreState;
+
+typedef struct {
+    ExploreState*   state;
+    int32_t         parent;
+    ExplorePath     path;
+    bool            newScreen;
+} ExploreChild;
+
+typedef struct {
+    int32_t     node;
+    Page*       pages[FB_PAGES];
+} ExploreScreen;
+
+typedef struct {
+    _Atomic uint64_t*   slots;
+    uint32_t            mask;
+    int32_t             limit;
+    SDL_atomic_t        count;
+} ExploreSet;
+
+typedef struct {
+    SDL_Thread*     thread;
+    ExploreState*   parent;
+    ExplorePath     path;
+    Chip8CPU        base;
+    Chip8CPU        cpu;
+    Chip8CPU        branch[EXPLORE_FRAME_RANDOMS];
+    ExploreChild*   children;
+    int32_t         childCount;
+    int32_t         childCapacity;
+} ExploreWorker;
+
+static ExploreSet states;
+static ExploreSet screens;
+static SDL_atomic_t full;
+static SDL_atomic_t screensFull;
+
+static ExploreState** frontier = NULL;
+static int32_t frontierCount = 0;
+static SDL_atomic_t frontierNext;
+
+static void* exploreAlloc(void* ptr, size_t size)
+{
+    ptr = realloc(ptr, size);
+    if (ptr == NULL) {
+        fprintf(stderr, "malloc error.\n");
+        exit(1);
+    }
+    return ptr;
+}
+
+static void exploreSetInit(ExploreSet* set, int32_t limit)
+{
+    uint32_t capacity = 1;
+
+    /* Keep the table at most half full so probes stay short */
+    while (capacity < (uint32_t)limit * 2) {
+        capacity <<= 1;
+    }
+    set->slots = calloc(capacity, sizeof(uint64_t));
+    if (set->slots == NULL) {
+        fprintf(stderr, "malloc error.\n");
+        exit(1);
+    }
+    set->mask = capacity - 1;
+    set->limit = limit;
+    SDL_AtomicSet(&set->count, 0);
+}
+
+/*
+ * Lock-free open addressing; zero marks an empty slot.  Returns 1 if the
+ * hash was added, 0 if it was already there and -1 if the set is full.
+ */
+static int32_t exploreSetInsert(ExploreSet* set, uint64_t hash)
+{
+    uint64_t slot;
+    uint32_t i;
+
+    if (hash == 0) {
+        hash = 1;
+    }
+    for (i = hash & set->mask; ; i = (i + 1) & set->mask) {
+        slot = atomic_load_explicit(&set->slots[i], memory_order_relaxed);
+        if (slot == hash) {
+            return 0;
+        }
+        if (slot != 0) {
+            continue;
+        }
+        if (SDL_AtomicGet(&set->count) >= set->limit) {
+            return -1;
+        }
+        if (atomic_compare_exchange_strong(&set->slots[i], &slot, hash)) {
+            SDL_AtomicAdd(&set->count, 1);
+            return 1;
+        }
+        if (slot == hash) {
+            return 0;
+        }
+    }
+}
+
+static uint8_t* exploreCPUPage(Chip8CPU* cpu, int32_t page)
+{
+    if (page < RAM_PAGES) {
+        return &cpu->ram[page * PAGE_SIZE];
+    }
+    return &cpu->framebuff[(page - RAM_PAGES) * PAGE_SIZE];
+}
+
+static uint64_t exploreRegsHash(const Chip8CPU* cpu)
+{
+    uint8_t regs[16 + 7 + STACK_SIZE * 2];
+    int32_t i;
+
+    memcpy(regs, cpu->V, 16);
+    regs[16] = cpu->DT;
+    regs[17] = cpu->ST;
+    regs[18] = cpu->PC & 0xFF;
+    regs[19] = cpu->PC >> 8;
+    regs[20] = cpu->I & 0xFF;
+    regs[21] = cpu->I >> 8;
+    regs[22] = cpu->SP;
+    for (i = 0; i < STACK_SIZE; i++) {
+        regs[23 + i * 2] = cpu->stack[i] & 0xFF;
+        regs[24 + i * 2] = cpu->stack[i] >> 8;
+    }
+    return pageHash(regs, sizeof(regs));
+}
+
+static uint64_t exploreScreenHash(const uint64_t* pageHashes)
+{
+    uint64_t hash = 0;
+    int32_t i;
+
+    for (i = RAM_PAGES; i < STATE_PAGES; i++) {
+        hash = pageHashCombine(hash, pageHashes[i]);
+    }
+    return hash;
+}
+
+/* Builds a state from cpu, sharing every page of prev not set in changed */
+static ExploreState* exploreStateCreate(Chip8CPU* cpu, const ExploreState* prev, uint32_t changed)
+{
+    ExploreState* state = exploreAlloc(NULL, sizeof(ExploreState));
+    int32_t i;
+
+    memcpy(state->V, cpu->V, sizeof(state->V));
+    state->DT = cpu->DT;
+    state->ST = cpu->ST;
+    state->PC = cpu->PC;
+    state->I  = cpu->I;
+    state->SP = cpu->SP;
+    memcpy(state->stack, cpu->stack, sizeof(state->stack));
+    for (i = 0; i < STATE_PAGES; i++) {
+        if (prev != NULL && !(changed & (1u << i))) {
+            pageRetain(prev->pages[i]);
+            state->pages[i] = prev->pages[i];
+        } else {
+            state->pages[i] = pageCreate(exploreCPUPage(cpu, i));
+        }
+    }
+    state->node = -1;
+    return state;
+}
+
+static void exploreStateLoad(const ExploreState* state, Chip8CPU* cpu)
+{
+    int32_t i;
+
+    memcpy(cpu->V, state->V, sizeof(cpu->V));
+    cpu->DT = state->DT;
+    cpu->ST = state->ST;
+    cpu->PC = state->PC;
+    cpu->I  = state->I;
+    cpu->SP = state->SP;
+    cpu->dirty = 0;
+    cpu->written = 0;
+    memcpy(cpu->stack, state->stack, sizeof(cpu->stack));
+    for (i = 0; i < STATE_PAGES; i++) {
+        memcpy(exploreCPUPage(cpu, i), state->pages[i]->data, PAGE_SIZE);
+    }
+    memset(cpu->key, 0, sizeof(cpu->key));
+}
+
+static void exploreStateFree(ExploreState* state)
+{
+    int32_t i;
+
+    for (i = 0; i < STATE_PAGES; i++) {
+        pageRelease(state->pages[i]);
+    }
+    free(state);
+}
+
+/* Called at the end of each frame; keeps the machine if it is a new state */
+static void exploreEmit(ExploreWorker* worker, Chip8CPU* cpu)
+{
+    const ExploreState* parent = worker->parent;
+    uint64_t pageHashes[STATE_PAGES];
+    uint64_t hash;
+    uint32_t changed = 0;
+    ExploreChild* child;
+    int32_t i, added;
+
+    /*
+     * RAM pages the frame did not store to are the parent's; only stored
+     * pages and the screen are compared.  Unchanged pages reuse the
+     * parent's cached hash.
+     */
+    hash = exploreRegsHash(cpu);
+    for (i = 0; i < STATE_PAGES; i++) {
+        if ((i >= RAM_PAGES || (cpu->written & (1u << i))) &&
+            memcmp(parent->pages[i]->data, exploreCPUPage(cpu, i), PAGE_SIZE) != 0) {
+            changed |= 1u << i;
+            pageHashes[i] = pageHash(exploreCPUPage(cpu, i), PAGE_SIZE);
+        } else {
+            pageHashes[i] = parent->pages[i]->hash;
+        }
+        hash = pageHashCombine(hash, pageHashes[i]);
+    }
+
+    added = exploreSetInsert(&states, hash);
+    if (added < 0) {
+        SDL_AtomicSet(&full, 1);
+    }
+    if (added <= 0) {
+        return;
+    }
+
+    if (worker->childCount == worker->childCapacity) {
+        worker->childCapacity = worker->childCapacity ? worker->childCapacity * 2 : 256;
+        worker->children = exploreAlloc(worker->children, worker->childCapacity * sizeof(ExploreChild));
+    }
+    child = &worker->children[worker->childCount++];
+    child->state = exploreStateCreate(cpu, parent, changed);
+    child->parent = parent->node;
+    child->path = worker->path;
+
+    added = exploreSetInsert(&screens, exploreScreenHash(pageHashes));
+    if (added < 0) {
+        SDL_AtomicSet(&screensFull, 1);
+    }
+    child->newScreen = added > 0;
+}
+
+/* Spreads the bits of index over the set bits of mask */
+static uint8_t exploreDeposit(uint32_t index, uint8_t mask)
+{
+    uint8_t value = 0;
+    uint32_t m;
+
+    for (m = mask; m != 0; m &= m - 1) {
+        if (index & 1) {
+            value |= m & -m;
+        }
+        index >>= 1;
+    }
+    return value;
+}
+
+/* Runs the rest of a frame, forking on RND until the frame's quota is used */
+static void exploreFrame(ExploreWorker* worker, Chip8CPU* cpu, int32_t cycle)
+{
+    uint8_t mask, x;
+    uint32_t m, outcomes, tried, i;
+    int32_t depth;
+    Chip8CPU* branch;
+
+    for (; cycle < CYCLES_PER_FRAME_TIME; cycle++) {
+        if ((cpu->ram[cpu->PC] & 0xF0) != 0xC0) {
+            cpuExecute(cpu);
+            continue;
+        }
+
+        /* Past the per-frame quota RND reads as 0 so paths stay replayable */
+        x    = cpu->ram[cpu->PC] & 0x0F;
+        mask = cpu->ram[cpu->PC + 1];
+        if (worker->path.rndCount == EXPLORE_FRAME_RANDOMS) {
+            cpu->V[x] = 0;
+            cpu->PC += 2;
+            continue;
+        }
+
+        outcomes = 1;
+        for (m = mask; m != 0; m &= m - 1) {
+            outcomes <<= 1;
+        }
+        tried = (outcomes < EXPLORE_MAX_RANDOM) ? outcomes : EXPLORE_MAX_RANDOM;
+
+        depth = worker->path.rndCount++;
+        branch = &worker->branch[depth];
+        for (i = 0; i < tried; i++) {
+            memcpy(branch, cpu, sizeof(Chip8CPU));
+            branch->V[x] = exploreDeposit(i * outcomes / tried, mask);
+            branch->PC += 2;
+            worker->path.rnd[depth] = branch->V[x];
+            exploreFrame(worker, branch, cycle + 1);
+        }
+        worker->path.rndCount--;
+        return;
+    }
+    cpuUpdateTimers(cpu);
+    exploreEmit(worker, cpu);
+}
+
+static int exploreWorker(void* data)
+{
+    ExploreWorker* worker = data;
+    int32_t i, key;
+
+    while ((i = SDL_AtomicAdd(&frontierNext, 1)) < frontierCount) {
+        worker->parent = frontier[i];
+        exploreStateLoad(worker->parent, &worker->base);
+
+        for (key = 0; key <= NO_KEY; key++) {
+            memcpy(&worker->cpu, &worker->base, sizeof(Chip8CPU));
+            if (key != NO_KEY) {
+                worker->cpu.key[key] = 1;
+            }
+            worker->path.key = key;
+            worker->path.rndCount = 0;
+            exploreFrame(worker, &worker->cpu, 0);
+        }
+    }
+    return 0;
+}
+
+static void exploreWritePath(FILE* fp, const ExploreNode* nodes, int32_t node)
+{
+    const ExplorePath* path;
+    int32_t count = 0, i, j;
+    int32_t* chain;
+
+    for (i = node; nodes[i].parent >= 0; i = nodes[i].parent) {
+        count++;
+    }
+    chain = exploreAlloc(NULL, (count + 1) * sizeof(int32_t));
+    for (i = node, j = count; j > 0; i = nodes[i].parent) {
+        chain[--j] = i;
+    }
+
+    /* One token per frame: the held key or '-', then any RND results */
+    for (i = 0; i < count; i++) {
+        path = &nodes[ chain[i] ].path;
+        if (path->key == NO_KEY) {
+            fputs(" -", fp);
+        } else {
+            fprintf(fp, " %X", path->key);
+        }
+        for (j = 0; j < path->rndCount; j++) {
+            fprintf(fp, ":%02x", path->rnd[j]);
+        }
+    }
+    fputc('\n', fp);
+    free(chain);
+}
+
+int32_t exploreRun(const char* file, int32_t depth)
+{
+    Chip8CPU* cpu;
+    ExploreWorker* workers;
+    ExploreNode* nodes = NULL;
+    ExploreScreen* shots = NULL;
+    ExploreState** next = NULL;
+    ExploreChild* child;
+    uint64_t pageHashes[STATE_PAGES];
+    uint64_t hash;
+    uint8_t framebuff[FRAMEBUFF_SIZE];
+    char name[32];
+    int32_t nodeCount = 0, nodeCapacity = 0;
+    int32_t shotCount = 0, nextCount, nextCapacity = 0;
+    int32_t i, j, k, level, workerCount;
+    FILE* fp;
+
+    cpu = aligned_alloc(CPU_ALIGN, sizeof(Chip8CPU));
+    if (cpu == NULL) {
+        fprintf(stderr, "malloc error.\n");
+        return -1;
+    }
+    cpuInit(cpu);
+    if (chip8LoadROM(cpu, file) <= 0) {
+        free(cpu);
+        return -1;
+    }
+
+    exploreSetInit(&states, EXPLORE_MAX_STATES);
+    exploreSetInit(&screens, EXPLORE_MAX_SCREENS);
+    SDL_AtomicSet(&full, 0);
+    SDL_AtomicSet(&screensFull, 0);
+
+    workerCount = SDL_GetCPUCount();
+    workers = aligned_alloc(CPU_ALIGN, workerCount * sizeof(ExploreWorker));
+    shots = calloc(EXPLORE_MAX_SCREENS, sizeof(ExploreScreen));
+    if (workers == NULL || shots == NULL) {
+        fprintf(stderr, "malloc error.\n");
+        exit(1);
+    }
+    memset(workers, 0, workerCount * sizeof(ExploreWorker));
+
+    /* The freshly loaded machine is node 0 */
+    frontier = exploreAlloc(NULL, sizeof(ExploreState*));
+    frontier[0] = exploreStateCreate(cpu, NULL, 0);
+    frontier[0]->node = 0;
+    frontierCount = 1;
+
+    hash = exploreRegsHash(cpu);
+    for (i = 0; i < STATE_PAGES; i++) {
+        pageHashes[i] = frontier[0]->pages[i]->hash;
+        hash = pageHashCombine(hash, pageHashes[i]);
+    }
+    exploreSetInsert(&states, hash);
+    exploreSetInsert(&screens, exploreScreenHash(pageHashes));
+    free(cpu);
+
+    nodeCapacity = 1024;
+    nodes = exploreAlloc(NULL, nodeCapacity * sizeof(ExploreNode));
+    memset(&nodes[0], 0, sizeof(ExploreNode));
+    nodes[0].parent = -1;
+    nodeCount = 1;
+
+    shots[0].node = 0;
+    for (k = 0; k < FB_PAGES; k++) {
+        shots[0].pages[k] = frontier[0]->pages[RAM_PAGES + k];
+        pageRetain(shots[0].pages[k]);
+    }
+    shotCount = 1;
+
+    /* A search that can no longer record screens has nothing left to find */
+    for (level = 0; level < depth && frontierCount > 0 &&
+                    !SDL_AtomicGet(&full) && !SDL_AtomicGet(&screensFull); level++) {
+        SDL_AtomicSet(&frontierNext, 0);
+        for (i = 0; i < workerCount; i++) {
+            workers[i].childCount = 0;
+            workers[i].thread = SDL_CreateThread(exploreWorker, "explore", &workers[i]);
+        }
+        for (i = 0; i < workerCount; i++) {
+            SDL_WaitThread(workers[i].thread, NULL);
+        }
+
+        /* Number the new states and gather the next frontier */
+        nextCount = 0;
+        for (i = 0; i < workerCount; i++) {
+            for (j = 0; j < workers[i].childCount; j++) {
+                child = &workers[i].children[j];
+
+                if (nodeCount == nodeCapacity) {
+                    nodeCapacity *= 2;
+                    nodes = exploreAlloc(nodes, nodeCapacity * sizeof(ExploreNode));
+                }
+                child->state->node = nodeCount;
+                nodes[nodeCount].parent = child->parent;
+                nodes[nodeCount].path = child->path;
+                nodeCount++;
+
+                if (child->newScreen && shotCount == EXPLORE_MAX_SCREENS) {
+                    SDL_AtomicSet(&screensFull, 1);
+                } else if (child->newScreen) {
+                    shots[shotCount].node = child->state->node;
+                    for (k = 0; k < FB_PAGES; k++) {
+                        shots[shotCount].pages[k] = child->state->pages[RAM_PAGES + k];
+                        pageRetain(shots[shotCount].pages[k]);
+                    }
+                    shotCount++;
+                }
+
+                if (nextCount == nextCapacity) {
+                    nextCapacity = nextCapacity ? nextCapacity * 2 : 1024;
+                    next = exploreAlloc(next, nextCapacity * sizeof(ExploreState*));
+                }
+                next[nextCount++] = child->state;
+            }
+        }
+
+        for (i = 0; i < frontierCount; i++) {
+            exploreStateFree(frontier[i]);
+        }
+        free(frontier);
+        frontier = next;
+        frontierCount = nextCount;
+        next = NULL;
+        nextCapacity = 0;
+
+        printf("frame %d: %d new states, %d screens\n", level + 1, frontierCount, shotCount);
+    }
+
+    if (SDL_AtomicGet(&full)) {
+        printf("Stopped after %d states.\n", EXPLORE_MAX_STATES);
+    }
+    if (SDL_AtomicGet(&screensFull)) {
+        printf("Stopped after %d screens; later screens were not written.\n", EXPLORE_MAX_SCREENS);
+    }
+
+    fp = fopen("explore.txt", "w");
+    if (fp == NULL) {
+        fprintf(stderr, "Could not open explore.txt\n");
+    }
+    for (i = 0; i < shotCount; i++) {
+        for (k = 0; k < FB_PAGES; k++) {
+            memcpy(&framebuff[k * PAGE_SIZE], shots[i].pages[k]->data, PAGE_SIZE);
+            pageRelease(shots[i].pages[k]);
+        }
+        snprintf(name, sizeof(name), "explore-%04d.png", i);
+        captureWritePNG(name, framebuff);
+        if (fp != NULL) {
+            fprintf(fp, "%s:", name);
+            exploreWritePath(fp, nodes, shots[i].node);
+        }
+    }
+    if (fp != NULL) {
+        fclose(fp);
+    }
+
+    for (i = 0; i < frontierCount; i++) {
+        exploreStateFree(frontier[i]);
+    }
+    free(frontier);
+    frontier = NULL;
+    for (i = 0; i < workerCount; i++) {
+        free(workers[i].children);
+    }
+    free(workers);
+    free(shots);
+    free(nodes);
+    free((void*)states.slots);
+    free((void*)screens.slots);
+    return 0;
+}
@@ -0,0 +1,13 @@
+#ifndef EXPLORE_H
+#define EXPLORE_H
+
+#include <stdint.h>
+
+#define EXPLORE_MAX_STATES      (1 << 20)
+#define EXPLORE_MAX_SCREENS     4096
+#define EXPLORE_MAX_RANDOM      16      /* outcomes tried per RND */
+#define EXPLORE_FRAME_RANDOMS   4       /* RNDs per frame that branch */
+
+int32_t exploreRun(const char* file, int32_t depth);
+
+#endif
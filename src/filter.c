@@ -0,0 +1,309 @@
+#include <string.h>
+#include "filter.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+
+#define SELECT(mask, a, b)  _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b))
+#define EQ(a, b)            _mm_cmpeq_epi8(a, b)
+#define LOAD(p)             _mm_loadu_si128((const __m128i*)(p))
+#define STORE(p, v)         _mm_storeu_si128((__m128i*)(p), v)
+#endif
+
+/*
+ * The scaling kernels read their neighbours from a copy of the framebuffer
+ * with a one pixel border (edge pixels replicated) so that every 16 byte
+ * load stays inside the buffer without bounds checks.
+ */
+#define PAD         16
+#define PAD_WIDTH   (SCREEN_WIDTH + 2 * PAD)
+
+typedef struct {
+    const char* name;
+    palette_t   pal;
+} NamedPalette;
+
+static const NamedPalette Palettes[] = {
+    { "mono",  { 0x00000000, 0x00FFFFFF } },
+    { "green", { 0x00102010, 0x0033FF66 } },
+    { "amber", { 0x00201000, 0x00FFB000 } },
+    { "lcd",   { 0x009BBC0F, 0x000F380F } },
+};
+
+static palette_t palette = { 0x00000000, 0x00FFFFFF };
+static uint8_t padded[(SCREEN_HEIGHT + 2) * PAD_WIDTH];
+static uint8_t scaled[FILTER_MAXSIZE];
+
+filter_t filterFromName(const char* name)
+{
+    if (strcmp(name, "nearest") == 0)
+        return FILTER_NEAREST;
+    /* EPX and Scale2x produce identical output */
+    if (strcmp(name, "scale2x") == 0 || strcmp(name, "epx") == 0)
+        return FILTER_SCALE2X;
+    if (strcmp(name, "scale3x") == 0)
+        return FILTER_SCALE3X;
+    if (strcmp(name, "scanline") == 0)
+        return FILTER_SCANLINE;
+    return FILTER_COUNT;
+}
+
+int32_t filterScale(filter_t filter)
+{
+    switch (filter) {
+        case FILTER_SCALE2X:
+            return 2;
+        case FILTER_SCALE3X:
+        case FILTER_SCANLINE:
+            return 3;
+        default:
+            return 1;
+    }
+}
+
+int32_t filterSetPalette(const char* name)
+{
+    for (size_t i = 0; i < sizeof(Palettes) / sizeof(Palettes[0]); i++) {
+        if (strcmp(name, Palettes[i].name) == 0) {
+            palette = Palettes[i].pal;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+palette_t filterGetPalette(void)
+{
+    return palette;
+}
+
+void filterExpand(const uint8_t* src, uint32_t* dst, int32_t count, palette_t pal)
+{
+    int32_t i = 0;
+
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bg   = _mm_set1_epi32((int32_t)pal.bg);
+    const __m128i diff = _mm_set1_epi32((int32_t)(pal.bg ^ pal.fg));
+
+    for (; i + 16 <= count; i += 16) {
+        /* 0xFF for every pixel that is off, widened to 32 bits */
+        __m128i off = EQ(LOAD(&src[i]), zero);
+        __m128i lo  = _mm_unpacklo_epi8(off, off);
+        __m128i hi  = _mm_unpackhi_epi8(off, off);
+
+        STORE(&dst[i + 0],  _mm_xor_si128(bg, _mm_andnot_si128(_mm_unpacklo_epi16(lo, lo), diff)));
+        STORE(&dst[i + 4],  _mm_xor_si128(bg, _mm_andnot_si128(_mm_unpackhi_epi16(lo, lo), diff)));
+        STORE(&dst[i + 8],  _mm_xor_si128(bg, _mm_andnot_si128(_mm_unpacklo_epi16(hi, hi), diff)));
+        STORE(&dst[i + 12], _mm_xor_si128(bg, _mm_andnot_si128(_mm_unpackhi_epi16(hi, hi), diff)));
+    }
+#endif
+
+    for (; i < count; i++) {
+        dst[i] = src[i] ? pal.fg : pal.bg;
+    }
+}
+
+static void filterPad(const uint8_t* framebuff)
+{
+    int32_t y;
+    uint8_t* row;
+
+    for (y = 0; y < SCREEN_HEIGHT; y++) {
+        row = &padded[(y + 1) * PAD_WIDTH + PAD];
+        memcpy(row, &framebuff[y * SCREEN_WIDTH], SCREEN_WIDTH);
+        row[-1] = row[0];
+        row[SCREEN_WIDTH] = row[SCREEN_WIDTH - 1];
+    }
+    memcpy(padded, &padded[PAD_WIDTH], PAD_WIDTH);
+    memcpy(&padded[(SCREEN_HEIGHT + 1) * PAD_WIDTH], &padded[SCREEN_HEIGHT * PAD_WIDTH], PAD_WIDTH);
+}
+
+/*
+ * Scale2x / AdvMAME2x.  With B, D, F, H the up, left, right and down
+ * neighbours of E, each source pixel becomes
+ *
+ *      E0 E1       E0 = D == B ? D : E     E1 = B == F ? F : E
+ *      E2 E3       E2 = D == H ? D : E     E3 = H == F ? F : E
+ *
+ * unless B == H or D == F, in which case all four are E.
+ */
+static void filterScale2xRow(const uint8_t* src, uint8_t* dst0, uint8_t* dst1)
+{
+    const uint8_t* up   = src - PAD_WIDTH;
+    const uint8_t* down = src + PAD_WIDTH;
+    int32_t x;
+
+#ifdef __SSE2__
+    for (x = 0; x < SCREEN_WIDTH; x += 16) {
+        __m128i B = LOAD(&up[x]);
+        __m128i D = LOAD(&src[x - 1]);
+        __m128i E = LOAD(&src[x]);
+        __m128i F = LOAD(&src[x + 1]);
+        __m128i H = LOAD(&down[x]);
+        __m128i keep = _mm_or_si128(EQ(B, H), EQ(D, F));
+
+        __m128i e0 = SELECT(_mm_andnot_si128(keep, EQ(D, B)), D, E);
+        __m128i e1 = SELECT(_mm_andnot_si128(keep, EQ(B, F)), F, E);
+        __m128i e2 = SELECT(_mm_andnot_si128(keep, EQ(D, H)), D, E);
+        __m128i e3 = SELECT(_mm_andnot_si128(keep, EQ(H, F)), F, E);
+
+        STORE(&dst0[2 * x],      _mm_unpacklo_epi8(e0, e1));
+        STORE(&dst0[2 * x + 16], _mm_unpackhi_epi8(e0, e1));
+        STORE(&dst1[2 * x],      _mm_unpacklo_epi8(e2, e3));
+        STORE(&dst1[2 * x + 16], _mm_unpackhi_epi8(e2, e3));
+    }
+#else
+    for (x = 0; x < SCREEN_WIDTH; x++) {
+        uint8_t B = up[x], D = src[x - 1], E = src[x], F = src[x + 1], H = down[x];
+        int32_t scale = (B != H && D != F);
+
+        dst0[2 * x]     = (scale && D == B) ? D : E;
+        dst0[2 * x + 1] = (scale && B == F) ? F : E;
+        dst1[2 * x]     = (scale && D == H) ? D : E;
+        dst1[2 * x + 1] = (scale && H == F) ? F : E;
+    }
+#endif
+}
+
+/*
+ * Scale3x / AdvMAME3x, using the full 3x3 neighbourhood
+ *
+ *      A B C       E0 E1 E2
+ *      D E F  ->   E3 E4 E5
+ *      G H I       E6 E7 E8
+ */
+static void filterScale3xRow(const uint8_t* src, uint8_t* dst0, uint8_t* dst1, uint8_t* dst2)
+{
+    const uint8_t* up   = src - PAD_WIDTH;
+    const uint8_t* down = src + PAD_WIDTH;
+    int32_t x;
+
+#ifdef __SSE2__
+    uint8_t out[9][16];
+
+    for (x = 0; x < SCREEN_WIDTH; x += 16) {
+        __m128i A = LOAD(&up[x - 1]),   B = LOAD(&up[x]),   C = LOAD(&up[x + 1]);
+        __m128i D = LOAD(&src[x - 1]),  E = LOAD(&src[x]),  F = LOAD(&src[x + 1]);
+        __m128i G = LOAD(&down[x - 1]), H = LOAD(&down[x]), I = LOAD(&down[x + 1]);
+        __m128i keep = _mm_or_si128(EQ(B, H), EQ(D, F));
+        __m128i DB = _mm_andnot_si128(keep, EQ(D, B));
+        __m128i BF = _mm_andnot_si128(keep, EQ(B, F));
+        __m128i DH = _mm_andnot_si128(keep, EQ(D, H));
+        __m128i HF = _mm_andnot_si128(keep, EQ(H, F));
+        __m128i EA = EQ(E, A), EC = EQ(E, C), EG = EQ(E, G), EI = EQ(E, I);
+
+        STORE(out[0], SELECT(DB, D, E));
+        STORE(out[1], SELECT(_mm_or_si128(_mm_andnot_si128(EC, DB), _mm_andnot_si128(EA, BF)), B, E));
+        STORE(out[2], SELECT(BF, F, E));
+        STORE(out[3], SELECT(_mm_or_si128(_mm_andnot_si128(EG, DB), _mm_andnot_si128(EA, DH)), D, E));
+        STORE(out[4], E);
+        STORE(out[5], SELECT(_mm_or_si128(_mm_andnot_si128(EI, BF), _mm_andnot_si128(EC, HF)), F, E));
+        STORE(out[6], SELECT(DH, D, E));
+        STORE(out[7], SELECT(_mm_or_si128(_mm_andnot_si128(EI, DH), _mm_andnot_si128(EG, HF)), H, E));
+        STORE(out[8], SELECT(HF, F, E));
+
+        for (int32_t i = 0; i < 16; i++) {
+            uint8_t* d0 = &dst0[3 * (x + i)];
+            uint8_t* d1 = &dst1[3 * (x + i)];
+            uint8_t* d2 = &dst2[3 * (x + i)];
+            d0[0] = out[0][i]; d0[1] = out[1][i]; d0[2] = out[2][i];
+            d1[0] = out[3][i]; d1[1] = out[4][i]; d1[2] = out[5][i];
+            d2[0] = out[6][i]; d2[1] = out[7][i]; d2[2] = out[8][i];
+        }
+    }
+#else
+    for (x = 0; x < SCREEN_WIDTH; x++) {
+        uint8_t A = up[x - 1],   B = up[x],   C = up[x + 1];
+        uint8_t D = src[x - 1],  E = src[x],  F = src[x + 1];
+        uint8_t G = down[x - 1], H = down[x], I = down[x + 1];
+        int32_t scale = (B != H && D != F);
+        int32_t DB = scale && D == B, BF = scale && B == F;
+        int32_t DH = scale && D == H, HF = scale && H == F;
+        uint8_t* d0 = &dst0[3 * x];
+        uint8_t* d1 = &dst1[3 * x];
+        uint8_t* d2 = &dst2[3 * x];
+
+        d0[0] = DB ? D : E;
+        d0[1] = ((DB && E != C) || (BF && E != A)) ? B : E;
+        d0[2] = BF ? F : E;
+        d1[0] = ((DB && E != G) || (DH && E != A)) ? D : E;
+        d1[1] = E;
+        d1[2] = ((BF && E != I) || (HF && E != C)) ? F : E;
+        d2[0] = DH ? D : E;
+        d2[1] = ((DH && E != I) || (HF && E != G)) ? H : E;
+        d2[2] = HF ? F : E;
+    }
+#endif
+}
+
+/*
+ * Scanlines: every source row becomes two full brightness rows followed by
+ * one row at half brightness, with each pixel tripled horizontally.
+ */
+static void filterScanlineRow(const uint8_t* src, uint32_t* dst, palette_t pal)
+{
+    uint32_t row[SCREEN_WIDTH];
+    int32_t x;
+
+    filterExpand(src, row, SCREEN_WIDTH, pal);
+
+#ifdef __SSE2__
+    for (x = 0; x < SCREEN_WIDTH; x += 4) {
+        __m128i p = LOAD(&row[x]);
+        STORE(&dst[3 * x],     _mm_shuffle_epi32(p, _MM_SHUFFLE(1, 0, 0, 0)));
+        STORE(&dst[3 * x + 4], _mm_shuffle_epi32(p, _MM_SHUFFLE(2, 2, 1, 1)));
+        STORE(&dst[3 * x + 8], _mm_shuffle_epi32(p, _MM_SHUFFLE(3, 3, 3, 2)));
+    }
+#else
+    for (x = 0; x < SCREEN_WIDTH; x++) {
+        dst[3 * x] = dst[3 * x + 1] = dst[3 * x + 2] = row[x];
+    }
+#endif
+}
+
+void filterApply(filter_t filter, const uint8_t* framebuff, uint32_t* pixels)
+{
+    const int32_t w2 = SCREEN_WIDTH * 2;
+    const int32_t w3 = SCREEN_WIDTH * 3;
+    palette_t dim;
+    int32_t y;
+
+    switch (filter) {
+        case FILTER_SCALE2X:
+            filterPad(framebuff);
+            for (y = 0; y < SCREEN_HEIGHT; y++) {
+                filterScale2xRow(&padded[(y + 1) * PAD_WIDTH + PAD],
+                                 &scaled[(2 * y) * w2],
+                                 &scaled[(2 * y + 1) * w2]);
+            }
+            filterExpand(scaled, pixels, FRAMEBUFF_SIZE * 4, palette);
+            break;
+
+        case FILTER_SCALE3X:
+            filterPad(framebuff);
+            for (y = 0; y < SCREEN_HEIGHT; y++) {
+                filterScale3xRow(&padded[(y + 1) * PAD_WIDTH + PAD],
+                                 &scaled[(3 * y) * w3],
+                                 &scaled[(3 * y + 1) * w3],
+                                 &scaled[(3 * y + 2) * w3]);
+            }
+            filterExpand(scaled, pixels, FRAMEBUFF_SIZE * 9, palette);
+            break;
+
+        case FILTER_SCANLINE:
+            dim.bg = (palette.bg >> 1) & 0x007F7F7F;
+            dim.fg = (palette.fg >> 1) & 0x007F7F7F;
+            for (y = 0; y < SCREEN_HEIGHT; y++) {
+                uint32_t* row = &pixels[(3 * y) * w3];
+                filterScanlineRow(&framebuff[y * SCREEN_WIDTH], row, palette);
+                memcpy(row + w3, row, w3 * sizeof(uint32_t));
+                filterScanlineRow(&framebuff[y * SCREEN_WIDTH], row + 2 * w3, dim);
+            }
+            break;
+
+        default:
+            filterExpand(framebuff, pixels, FRAMEBUFF_SIZE, palette);
+            break;
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stdint.h>
+#include "cpu.h"
+
+#define FILTER_MAXSCALE     3
+#define FILTER_MAXSIZE      (FRAMEBUFF_SIZE * FILTER_MAXSCALE * FILTER_MAXSCALE)
+
+typedef enum {
+    FILTER_NEAREST,
+    FILTER_SCALE2X,
+    FILTER_SCALE3X,
+    FILTER_SCANLINE,
+    FILTER_COUNT
+} filter_t;
+
+typedef struct {
+    uint32_t    bg;
+    uint32_t    fg;
+} palette_t;
+
+filter_t filterFromName(const char* name);
+int32_t filterScale(filter_t filter);
+int32_t filterSetPalette(const char* name);
+palette_t filterGetPalette(void);
+void filterExpand(const uint8_t* src, uint32_t* dst, int32_t count, palette_t pal);
+void filterApply(filter_t filter, const uint8_t* framebuff, uint32_t* pixels);
+
+#endif
@@ -0,0 +1,414 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chip8.h"
+#include "input.h"
+
+/*
+ * Host input is collected as press/release events.  The emulator runs the
+ * CPU up to the moment each event arrives and then applies it, so a key
+ * change lands on the cycle that was running when it happened.  Every
+ * change is held for at least a frame before the next change of the same
+ * key, which keeps taps shorter than a frame visible to the guest.
+ */
+
+#define HOLD_CYCLES             CYCLES_PER_FRAME_TIME
+#define PROBE_TIMEOUT_FRAMES    60
+#define PROBE_SEED              0x2545F491u
+
+typedef struct {
+    uint32_t    timestamp;
+    uint8_t     key;
+    uint8_t     pressed;
+} InputEvent;
+
+static const SDL_Scancode DefaultKeys[KEY_SIZE] = {
+    SDL_SCANCODE_X,
+    SDL_SCANCODE_1,
+    SDL_SCANCODE_2,
+    SDL_SCANCODE_3,
+    SDL_SCANCODE_Q,
+    SDL_SCANCODE_W,
+    SDL_SCANCODE_E,
+    SDL_SCANCODE_A,
+    SDL_SCANCODE_S,
+    SDL_SCANCODE_D,
+    SDL_SCANCODE_Z,
+    SDL_SCANCODE_C,
+    SDL_SCANCODE_4,
+    SDL_SCANCODE_R,
+    SDL_SCANCODE_F,
+    SDL_SCANCODE_V
+};
+
+/* D-pad on the 5/7/8/9 cluster most games use for movement */
+static const struct {
+    SDL_GameControllerButton    button;
+    uint8_t                     key;
+} DefaultButtons[] = {
+    { SDL_CONTROLLER_BUTTON_DPAD_UP,    0x5 },
+    { SDL_CONTROLLER_BUTTON_DPAD_LEFT,  0x7 },
+    { SDL_CONTROLLER_BUTTON_DPAD_DOWN,  0x8 },
+    { SDL_CONTROLLER_BUTTON_DPAD_RIGHT, 0x9 },
+    { SDL_CONTROLLER_BUTTON_A,          0x6 },
+    { SDL_CONTROLLER_BUTTON_B,          0x4 },
+    { SDL_CONTROLLER_BUTTON_BACK,       0x0 },
+    { SDL_CONTROLLER_BUTTON_START,      0xF },
+};
+
+static input_mode_t inputMode = INPUT_QUEUED;
+static bool mapLoaded = false;
+static int8_t scancodeMap[SDL_NUM_SCANCODES];
+static int8_t buttonMap[SDL_CONTROLLER_BUTTON_MAX];
+static uint8_t holdCount[KEY_SIZE];
+static uint32_t heldUntil[KEY_SIZE];
+static uint32_t keyMask = 0;
+static SDL_GameController* pads[INPUT_MAX_PADS];
+
+static InputEvent queue[INPUT_QUEUE_SIZE];
+static uint32_t queueHead = 0;
+static uint32_t queueTail = 0;
+
+static bool probeEnabled = false;
+static bool probePending = false;
+static uint32_t probeStamp = 0;
+static int32_t probeFrames = 0;
+static uint32_t probeCycle = 0;
+static uint8_t probeKey = 0;
+static Chip8CPU* probeCopy[2];      /* key left up, key pressed */
+static uint32_t probeRandom[2];
+static uint32_t samples = 0;
+static uint32_t minLatency = 0;
+static uint32_t maxLatency = 0;
+static uint64_t totalLatency = 0;
+
+/*
+ * One binding per line: a CHIP-8 key in hex followed by an SDL key name
+ * ("X", "Up", "Keypad 5") or a controller button prefixed with "pad:"
+ * ("pad:a", "pad:dpup").  '#' starts a comment.
+ */
+int32_t inputLoadMap(const char* file)
+{
+    char line[128];
+    char *p, *end;
+    unsigned long key;
+    int32_t lineNo = 0;
+    FILE* fp;
+
+    fp = fopen(file, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "Error opening key map: %s\n", file);
+        return -1;
+    }
+
+    memset(scancodeMap, -1, sizeof(scancodeMap));
+    memset(buttonMap, -1, sizeof(buttonMap));
+    mapLoaded = true;
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        lineNo++;
+        p = strchr(line, '#');
+        if (p != NULL) {
+            *p = '\0';
+        }
+        end = line + strlen(line);
+        while (end > line && isspace((unsigned char)end[-1])) {
+            *--end = '\0';
+        }
+        p = line;
+        while (isspace((unsigned char)*p)) {
+            p++;
+        }
+        if (*p == '\0') {
+            continue;
+        }
+
+        key = strtoul(p, &end, 16);
+        if (end == p || key >= KEY_SIZE || !isspace((unsigned char)*end)) {
+            fprintf(stderr, "%s:%d: expected a key from 0 to F\n", file, lineNo);
+            fclose(fp);
+            return -1;
+        }
+        p = end;
+        while (isspace((unsigned char)*p)) {
+            p++;
+        }
+
+        if (strncmp(p, "pad:", 4) == 0) {
+            SDL_GameControllerButton button = SDL_GameControllerGetButtonFromString(p + 4);
+            if (button == SDL_CONTROLLER_BUTTON_INVALID) {
+                fprintf(stderr, "%s:%d: unknown controller button: %s\n", file, lineNo, p + 4);
+                fclose(fp);
+                return -1;
+            }
+            buttonMap[button] = key;
+        } else {
+            SDL_Scancode scancode = SDL_GetScancodeFromName(p);
+            if (scancode == SDL_SCANCODE_UNKNOWN) {
+                fprintf(stderr, "%s:%d: unknown key name: %s\n", file, lineNo, p);
+                fclose(fp);
+                return -1;
+            }
+            scancodeMap[scancode] = key;
+        }
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+void inputInit(input_mode_t mode, bool latencyProbe)
+{
+    size_t i;
+
+    if (!mapLoaded) {
+        memset(scancodeMap, -1, sizeof(scancodeMap));
+        memset(buttonMap, -1, sizeof(buttonMap));
+        for (i = 0; i < KEY_SIZE; i++) {
+            scancodeMap[ DefaultKeys[i] ] = i;
+        }
+        for (i = 0; i < sizeof(DefaultButtons) / sizeof(DefaultButtons[0]); i++) {
+            buttonMap[ DefaultButtons[i].button ] = DefaultButtons[i].key;
+        }
+    }
+
+    /* Controllers already plugged in arrive as SDL_CONTROLLERDEVICEADDED */
+    if (SDL_InitSubSystem(SDL_INIT_GAMECONTROLLER) != 0) {
+        fprintf(stderr, "Could not initialize game controllers: %s\n", SDL_GetError());
+    }
+
+    inputMode = mode;
+    probeEnabled = latencyProbe;
+    if (probeEnabled) {
+        probeCopy[0] = aligned_alloc(CPU_ALIGN, sizeof(Chip8CPU));
+        probeCopy[1] = aligned_alloc(CPU_ALIGN, sizeof(Chip8CPU));
+        if (probeCopy[0] == NULL || probeCopy[1] == NULL) {
+            fprintf(stderr, "malloc error.\n");
+            exit(1);
+        }
+    }
+}
+
+void inputExit(void)
+{
+    int32_t i;
+
+    for (i = 0; i < INPUT_MAX_PADS; i++) {
+        if (pads[i] != NULL) {
+            SDL_GameControllerClose(pads[i]);
+            pads[i] = NULL;
+        }
+    }
+
+    if (probeEnabled && samples > 0) {
+        printf("Input latency over %u presses: min %u ms, avg %u ms, max %u ms\n",
+               samples, minLatency, (uint32_t)(totalLatency / samples), maxLatency);
+    }
+    free(probeCopy[0]);
+    free(probeCopy[1]);
+    probeCopy[0] = NULL;
+    probeCopy[1] = NULL;
+}
+
+static void inputKey(int32_t key, bool pressed, uint32_t timestamp)
+{
+    InputEvent* ev;
+
+    /* Several host inputs may share a key; only the first press and last release count */
+    if (pressed) {
+        if (holdCount[key]++ > 0) {
+            return;
+        }
+        keyMask |= 1u << key;
+    } else {
+        if (holdCount[key] == 0 || --holdCount[key] > 0) {
+            return;
+        }
+        keyMask &= ~(1u << key);
+    }
+
+    if (inputMode != INPUT_QUEUED || queueHead - queueTail >= INPUT_QUEUE_SIZE) {
+        return;
+    }
+    ev = &queue[queueHead++ % INPUT_QUEUE_SIZE];
+    ev->timestamp = timestamp;
+    ev->key = key;
+    ev->pressed = pressed;
+}
+
+void inputHandleEvent(const SDL_Event* event)
+{
+    SDL_GameController* pad;
+    int32_t i;
+
+    switch (event->type) {
+        case SDL_KEYDOWN:
+        case SDL_KEYUP:
+            if (!event->key.repeat && scancodeMap[ event->key.keysym.scancode ] >= 0) {
+                inputKey(scancodeMap[ event->key.keysym.scancode ],
+                         event->type == SDL_KEYDOWN, event->key.timestamp);
+            }
+            break;
+
+        case SDL_CONTROLLERBUTTONDOWN:
+        case SDL_CONTROLLERBUTTONUP:
+            if (event->cbutton.button < SDL_CONTROLLER_BUTTON_MAX && buttonMap[ event->cbutton.button ] >= 0) {
+                inputKey(buttonMap[ event->cbutton.button ],
+                         event->type == SDL_CONTROLLERBUTTONDOWN, event->cbutton.timestamp);
+            }
+            break;
+
+        case SDL_CONTROLLERDEVICEADDED:
+            for (i = 0; i < INPUT_MAX_PADS; i++) {
+                if (pads[i] == NULL) {
+                    pads[i] = SDL_GameControllerOpen(event->cdevice.which);
+                    break;
+                }
+            }
+            break;
+
+        case SDL_CONTROLLERDEVICEREMOVED:
+            pad = SDL_GameControllerFromInstanceID(event->cdevice.which);
+            for (i = 0; i < INPUT_MAX_PADS; i++) {
+                if (pads[i] != NULL && pads[i] == pad) {
+                    SDL_GameControllerClose(pads[i]);
+                    pads[i] = NULL;
+                }
+            }
+            break;
+    }
+}
+
+uint32_t inputKeyMask(void)
+{
+    return keyMask;
+}
+
+/*
+ * Latency probe.  A press starts two copies of the machine, one with the
+ * key left up and one with it pressed, fed the same RND values.  The first
+ * presented frame where their screens differ is the press's response;
+ * blinking cursors and other changes the key did not cause show up in
+ * both copies and are ignored.
+ */
+static void inputProbeStart(const Chip8CPU* cpu, const InputEvent* ev, uint32_t cycle)
+{
+    memcpy(probeCopy[0], cpu, sizeof(Chip8CPU));
+    memcpy(probeCopy[1], cpu, sizeof(Chip8CPU));
+    probeCopy[1]->key[ev->key] = 1;
+    probeRandom[0] = PROBE_SEED;
+    probeRandom[1] = PROBE_SEED;
+    probeKey = ev->key;
+    probeCycle = cycle;
+    probeStamp = ev->timestamp;
+    probeFrames = 0;
+    probePending = true;
+}
+
+/* Brings both copies up to cycle */
+static void inputProbeRun(uint32_t cycle)
+{
+    Chip8CPU* cpu;
+    uint32_t* seed;
+    int32_t i, n, count = (int32_t)(cycle - probeCycle);
+
+    for (i = 0; i < 2; i++) {
+        cpu = probeCopy[i];
+        seed = &probeRandom[i];
+        for (n = 0; n < count; n++) {
+            if ((cpu->ram[cpu->PC] & 0xF0) != 0xC0) {
+                cpuExecute(cpu);
+                continue;
+            }
+            *seed ^= *seed << 13;
+            *seed ^= *seed >> 17;
+            *seed ^= *seed << 5;
+            cpu->V[ cpu->ram[cpu->PC] & 0x0F ] = *seed & cpu->ram[cpu->PC + 1];
+            cpu->PC += 2;
+        }
+    }
+    probeCycle = cycle;
+}
+
+/*
+ * Applies the queued changes whose key has been held long enough at this
+ * cycle and returns how many cycles remain until the next held-back change
+ * is due, or INT32_MAX if none is waiting.  Later changes of a held key stay
+ * behind it so each key keeps its order.
+ */
+int32_t inputApply(Chip8CPU* cpu, uint32_t cycle)
+{
+    InputEvent* ev;
+    uint32_t i, kept = queueTail;
+    uint32_t blocked = 0;
+    int32_t left, wait = INT32_MAX;
+
+    for (i = queueTail; i != queueHead; i++) {
+        ev = &queue[i % INPUT_QUEUE_SIZE];
+        left = (int32_t)(heldUntil[ev->key] - cycle);
+        if (((blocked >> ev->key) & 1) || left > 0) {
+            if (left > 0 && left < wait) {
+                wait = left;
+            }
+            blocked |= 1u << ev->key;
+            queue[kept++ % INPUT_QUEUE_SIZE] = *ev;
+            continue;
+        }
+
+        /*
+         * Changes reach both probe copies, except that the probed key stays
+         * up in the first.  Pressing it again restarts the probe, since the
+         * earlier press had no visible effect.
+         */
+        if (probePending && !(ev->pressed && ev->key == probeKey)) {
+            inputProbeRun(cycle);
+            probeCopy[1]->key[ev->key] = ev->pressed;
+            if (ev->key != probeKey) {
+                probeCopy[0]->key[ev->key] = ev->pressed;
+            }
+        } else if (probeEnabled && ev->pressed) {
+            inputProbeStart(cpu, ev, cycle);
+        }
+
+        cpu->key[ev->key] = ev->pressed;
+        heldUntil[ev->key] = cycle + HOLD_CYCLES;
+    }
+    queueHead = kept;
+    return wait;
+}
+
+/*
+ * Called after each frame is presented, before its timer update; cycle is
+ * the count the machine has run to.
+ */
+void inputPresented(uint32_t cycle)
+{
+    uint32_t latency;
+
+    if (!probePending) {
+        return;
+    }
+
+    inputProbeRun(cycle);
+    if (memcmp(probeCopy[0]->framebuff, probeCopy[1]->framebuff, FRAMEBUFF_SIZE) != 0) {
+        latency = SDL_GetTicks() - probeStamp;
+        if (samples == 0 || latency < minLatency) {
+            minLatency = latency;
+        }
+        if (latency > maxLatency) {
+            maxLatency = latency;
+        }
+        totalLatency += latency;
+        samples++;
+        probePending = false;
+        return;
+    }
+
+    if (++probeFrames > PROBE_TIMEOUT_FRAMES) {
+        probePending = false;
+        return;
+    }
+    cpuUpdateTimers(probeCopy[0]);
+    cpuUpdateTimers(probeCopy[1]);
+}
@@ -0,0 +1,26 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+#include "cpu.h"
+
+#define INPUT_QUEUE_SIZE    256
+#define INPUT_MAX_PADS      4
+
+/* Queued feeds inputApply; mask-only callers just read inputKeyMask */
+typedef enum {
+    INPUT_QUEUED,
+    INPUT_MASK_ONLY
+} input_mode_t;
+
+int32_t inputLoadMap(const char* file);
+void inputInit(input_mode_t mode, bool latencyProbe);
+void inputExit(void);
+void inputHandleEvent(const SDL_Event* event);
+uint32_t inputKeyMask(void);
+int32_t inputApply(Chip8CPU* cpu, uint32_t cycle);
+void inputPresented(uint32_t cycle);
+
+#endif
@@ -1,24 +1,134 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include "bench.h"
 #include "chip8.h"
+#include "explore.h"
+#include "input.h"
+#include "recomp.h"
+#include "wall.h"
+
+static void usage(const char* prog)
+{
+    fprintf(stderr, "Usage: %s [-f filter] [-p palette] [-k keymap] [-l] [-r file] [-w count] [-x depth] [-b cycles] [-c out.c | -m module] ROM\n", prog);
+    fprintf(stderr, "  -f  nearest, scale2x, epx, scale3x, scanline\n");
+    fprintf(stderr, "  -p  mono, green, amber, lcd\n");
+    fprintf(stderr, "  -k  load key and controller bindings from a file\n");
+    fprintf(stderr, "  -l  report input-to-display latency on exit\n");
+    fprintf(stderr, "  -r  record gameplay to a .y4m or .gif file\n");
+    fprintf(stderr, "  -w  run count copies of the ROM side by side\n");
+    fprintf(stderr, "  -x  explore every screen reachable within depth frames\n");
+    fprintf(stderr, "  -b  time the interpreter and module, cycles at a time\n");
+    fprintf(stderr, "  -c  translate the ROM to C for building a module\n");
+    fprintf(stderr, "  -m  run with a recompiled ROM module\n");
+    exit(1);
+}
 
 int main(int argc, char **argv)
 {
     Chip8CPU* cpu = NULL;
+    Chip8Config config = { FILTER_NEAREST, NULL, false };
+    const char* translate = NULL;
+    const char* module = NULL;
+    int32_t wall = 0;
+    int32_t explore = 0;
+    int32_t bench = 0;
+    int32_t romSize;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:p:k:lr:w:x:b:c:m:")) != -1) {
+        switch (opt) {
+            case 'f':
+                config.filter = filterFromName(optarg);
+                if (config.filter == FILTER_COUNT) {
+                    fprintf(stderr, "Unknown filter: %s\n", optarg);
+                    usage(argv[0]);
+                }
+                break;
+
+            case 'p':
+                if (filterSetPalette(optarg) != 0) {
+                    fprintf(stderr, "Unknown palette: %s\n", optarg);
+                    usage(argv[0]);
+                }
+                break;
+
+            case 'k':
+                if (inputLoadMap(optarg) != 0) {
+                    exit(1);
+                }
+                break;
+
+            case 'l':
+                config.latency = true;
+                break;
+
+            case 'r':
+                config.record = optarg;
+                break;
+
+            case 'w':
+                wall = atoi(optarg);
+                break;
+
+            case 'x':
+                explore = atoi(optarg);
+                break;
+
+            case 'b':
+                bench = atoi(optarg);
+                break;
+
+            case 'c':
+                translate = optarg;
+                break;
 
-    if (argc != 2) {
+            case 'm':
+                module = optarg;
+                break;
+
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (optind != argc - 1) {
         fprintf(stderr, "No ROM file specified.\n");
-        exit(1);
+        usage(argv[0]);
+    }
+
+    if (wall > 0) {
+        return wallRun(argv[optind], wall, module) == 0 ? 0 : 1;
+    }
+    if (bench > 0) {
+        return benchRun(argv[optind], module, bench) == 0 ? 0 : 1;
+    }
+    if (explore > 0) {
+        return exploreRun(argv[optind], explore) == 0 ? 0 : 1;
     }
 
-    cpu = malloc(sizeof(Chip8CPU));
+    cpu = aligned_alloc(CPU_ALIGN, sizeof(Chip8CPU));
     if (cpu == NULL) {
         fprintf(stderr, "malloc error.\n");
         exit(1);
     }
 
-    chip8Init(cpu);
-    chip8LoadROM(cpu, argv[1]);
+    if (translate != NULL) {
+        cpuInit(cpu);
+        romSize = chip8LoadROM(cpu, argv[optind]);
+        if (romSize <= 0 || recompTranslate(cpu, romSize, translate) != 0) {
+            exit(1);
+        }
+        free(cpu);
+        return 0;
+    }
+
+    chip8Init(cpu, &config);
+    if (chip8LoadROM(cpu, argv[optind]) <= 0 ||
+        (module != NULL && recompLoad(cpu, module) != 0)) {
+        chip8Exit(cpu);
+        exit(1);
+    }
     chip8Execute(cpu);
 
     chip8Exit(cpu);
@@ -0,0 +1,57 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "page.h"
+
+#define HASH_SEED   0x9E3779B97F4A7C15ull
+#define HASH_MUL    0xFF51AFD7ED558CCDull
+
+uint64_t pageHashCombine(uint64_t hash, uint64_t value)
+{
+    hash = (hash ^ value) * HASH_MUL;
+    return hash ^ (hash >> 29);
+}
+
+uint64_t pageHash(const uint8_t* data, size_t len)
+{
+    uint64_t hash = HASH_SEED ^ len;
+    uint64_t word;
+    size_t i;
+
+    for (i = 0; i + 8 <= len; i += 8) {
+        memcpy(&word, &data[i], 8);
+        hash = pageHashCombine(hash, word);
+    }
+    if (i < len) {
+        word = 0;
+        memcpy(&word, &data[i], len - i);
+        hash = pageHashCombine(hash, word);
+    }
+    return hash;
+}
+
+Page* pageCreate(const uint8_t* data)
+{
+    Page* page = malloc(sizeof(Page));
+    if (page == NULL) {
+        fprintf(stderr, "malloc error.\n");
+        exit(1);
+    }
+
+    SDL_AtomicSet(&page->refs, 1);
+    memcpy(page->data, data, PAGE_SIZE);
+    page->hash = pageHash(data, PAGE_SIZE);
+    return page;
+}
+
+void pageRetain(Page* page)
+{
+    SDL_AtomicIncRef(&page->refs);
+}
+
+void pageRelease(Page* page)
+{
+    if (page != NULL && SDL_AtomicDecRef(&page->refs)) {
+        free(page);
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef PAGE_H
+#define PAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+#include "cpu.h"
+
+/*
+ * Reference-counted, hashed blocks of machine memory for the explorer's
+ * snapshots.  Snapshots that did not touch a page keep pointing at the
+ * same one.  A page is never modified after it is created, which keeps
+ * the hash valid; the instance pool writes its pages in place and uses
+ * its own unhashed PoolPage instead.
+ */
+
+#define PAGE_SIZE   CPU_PAGE_SIZE
+
+typedef struct {
+    SDL_atomic_t    refs;
+    uint64_t        hash;
+    uint8_t         data[PAGE_SIZE];
+} Page;
+
+uint64_t pageHash(const uint8_t* data, size_t len);
+uint64_t pageHashCombine(uint64_t hash, uint64_t value);
+Page* pageCreate(const uint8_t* data);
+void pageRetain(Page* page);
+void pageRelease(Page* page);
+
+#endif
@@ -0,0 +1,277 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pool.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifndef __SSE2__
+/* Byte-per-pixel expansion of each packed screen byte, lowest bit leftmost */
+static uint64_t expandTable[256];
+#endif
+
+static void poolPackScreen(uint8_t* packed, const uint8_t* framebuff)
+{
+    int32_t i;
+
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    uint32_t bits;
+
+    for (i = 0; i < FRAMEBUFF_SIZE; i += 16) {
+        __m128i px = _mm_loadu_si128((const __m128i*)&framebuff[i]);
+        bits = ~_mm_movemask_epi8(_mm_cmpeq_epi8(px, zero));
+        packed[i / 8]     = bits & 0xFF;
+        packed[i / 8 + 1] = (bits >> 8) & 0xFF;
+    }
+#else
+    int32_t bit;
+    uint8_t byte;
+
+    for (i = 0; i < FRAMEBUFF_SIZE / 8; i++) {
+        byte = 0;
+        for (bit = 0; bit < 8; bit++) {
+            byte |= (framebuff[i * 8 + bit] ? 1 : 0) << bit;
+        }
+        packed[i] = byte;
+    }
+#endif
+}
+
+static void poolExpandScreen(uint8_t* framebuff, const uint8_t* packed)
+{
+    int32_t i;
+
+#ifdef __SSE2__
+    const __m128i select = _mm_set_epi8(-128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1);
+    const __m128i one = _mm_set1_epi8(1);
+
+    for (i = 0; i < FRAMEBUFF_SIZE; i += 16) {
+        /* Spread the two bytes over eight lanes each, then test one bit per lane */
+        __m128i v = _mm_cvtsi32_si128(packed[i / 8] | (packed[i / 8 + 1] << 8));
+        v = _mm_unpacklo_epi8(v, v);
+        v = _mm_unpacklo_epi16(v, v);
+        v = _mm_unpacklo_epi32(v, v);
+        v = _mm_cmpeq_epi8(_mm_and_si128(v, select), select);
+        _mm_storeu_si128((__m128i*)&framebuff[i], _mm_and_si128(v, one));
+    }
+#else
+    for (i = 0; i < FRAMEBUFF_SIZE / 8; i++) {
+        memcpy(&framebuff[i * 8], &expandTable[ packed[i] ], 8);
+    }
+#endif
+}
+
+static PoolPage* poolPageCreate(const uint8_t* data)
+{
+    PoolPage* page = malloc(sizeof(PoolPage));
+    if (page == NULL) {
+        fprintf(stderr, "malloc error.\n");
+        exit(1);
+    }
+
+    SDL_AtomicSet(&page->refs, 1);
+    memcpy(page->data, data, CPU_PAGE_SIZE);
+    return page;
+}
+
+static void poolPageRelease(PoolPage* page)
+{
+    if (page != NULL && SDL_AtomicDecRef(&page->refs)) {
+        free(page);
+    }
+}
+
+/* The pool keeps one reference to each image page; every instance using it holds another */
+int32_t poolInit(InstancePool* pool, const Chip8CPU* cpu, int32_t capacity)
+{
+    Chip8Instance* image = &pool->image;
+    int32_t i;
+
+#ifndef __SSE2__
+    for (i = 0; i < 256; i++) {
+        uint8_t* bytes = (uint8_t*)&expandTable[i];
+        for (int32_t bit = 0; bit < 8; bit++) {
+            bytes[bit] = (i >> bit) & 1;
+        }
+    }
+#endif
+
+    pool->slab = aligned_alloc(CPU_ALIGN, capacity * sizeof(Chip8Instance));
+    pool->freeList = malloc(capacity * sizeof(int32_t));
+    if (pool->slab == NULL || pool->freeList == NULL) {
+        fprintf(stderr, "malloc error.\n");
+        free(pool->slab);
+        free(pool->freeList);
+        return -1;
+    }
+    pool->capacity = capacity;
+    pool->freeCount = capacity;
+    pool->lock = 0;
+    for (i = 0; i < capacity; i++) {
+        pool->freeList[i] = capacity - 1 - i;
+    }
+
+    memset(image, 0, sizeof(Chip8Instance));
+    memcpy(image->V, cpu->V, sizeof(image->V));
+    image->PC = cpu->PC;
+    image->I  = cpu->I;
+    image->stale = cpu->stale;
+    image->SP = cpu->SP;
+    image->DT = cpu->DT;
+    image->ST = cpu->ST;
+    memcpy(image->stack, cpu->stack, sizeof(image->stack));
+    for (i = 0; i < CPU_PAGES; i++) {
+        image->pages[i] = poolPageCreate(&cpu->ram[i * CPU_PAGE_SIZE]);
+    }
+    poolPackScreen(image->framebuff, cpu->framebuff);
+    return 0;
+}
+
+void poolExit(InstancePool* pool)
+{
+    int32_t i;
+
+    for (i = 0; i < CPU_PAGES; i++) {
+        poolPageRelease(pool->image.pages[i]);
+    }
+    free(pool->slab);
+    free(pool->freeList);
+    pool->slab = NULL;
+    pool->freeList = NULL;
+}
+
+/* Returns a machine in the pool's initial state, or NULL when all are in use */
+Chip8Instance* poolAcquire(InstancePool* pool)
+{
+    Chip8Instance* instance = NULL;
+    int32_t i;
+
+    SDL_AtomicLock(&pool->lock);
+    if (pool->freeCount > 0) {
+        instance = &pool->slab[ pool->freeList[--pool->freeCount] ];
+    }
+    SDL_AtomicUnlock(&pool->lock);
+
+    if (instance != NULL) {
+        memcpy(instance, &pool->image, sizeof(Chip8Instance));
+        for (i = 0; i < CPU_PAGES; i++) {
+            SDL_AtomicIncRef(&instance->pages[i]->refs);
+        }
+    }
+    return instance;
+}
+
+void poolRelease(InstancePool* pool, Chip8Instance* instance)
+{
+    int32_t i;
+
+    for (i = 0; i < CPU_PAGES; i++) {
+        poolPageRelease(instance->pages[i]);
+    }
+
+    SDL_AtomicLock(&pool->lock);
+    pool->freeList[pool->freeCount++] = instance - pool->slab;
+    SDL_AtomicUnlock(&pool->lock);
+}
+
+int32_t poolScratchInit(InstanceScratch* scratch, const InstancePool* pool)
+{
+    scratch->pool = pool;
+    scratch->cpu = aligned_alloc(CPU_ALIGN, sizeof(Chip8CPU));
+    if (scratch->cpu == NULL) {
+        fprintf(stderr, "malloc error.\n");
+        return -1;
+    }
+    memset(scratch->cpu, 0, sizeof(Chip8CPU));
+    memset(scratch->loaded, 0, sizeof(scratch->loaded));
+    memset(scratch->screen, 0, sizeof(scratch->screen));
+    return 0;
+}
+
+void poolScratchExit(InstanceScratch* scratch)
+{
+    free(scratch->cpu);
+    scratch->cpu = NULL;
+}
+
+/*
+ * Image pages and a screen already in the scratch are not copied again, so
+ * switching between instances of one ROM mostly moves their private pages.
+ */
+Chip8CPU* poolSwapIn(InstanceScratch* scratch, const Chip8Instance* instance)
+{
+    Chip8CPU* cpu = scratch->cpu;
+    const PoolPage* page;
+    int32_t i;
+
+    memcpy(cpu->V, instance->V, sizeof(cpu->V));
+    cpu->PC = instance->PC;
+    cpu->I  = instance->I;
+    cpu->stale = instance->stale;
+    cpu->SP = instance->SP;
+    cpu->DT = instance->DT;
+    cpu->ST = instance->ST;
+    cpu->dirty = 0;
+    cpu->written = 0;
+    memcpy(cpu->stack, instance->stack, sizeof(cpu->stack));
+
+    for (i = 0; i < CPU_PAGES; i++) {
+        page = instance->pages[i];
+        if (page == scratch->loaded[i]) {
+            continue;
+        }
+        memcpy(&cpu->ram[i * CPU_PAGE_SIZE], page->data, CPU_PAGE_SIZE);
+        scratch->loaded[i] = (page == scratch->pool->image.pages[i]) ? page : NULL;
+    }
+
+    /* Copies of one ROM often show the same screen */
+    if (memcmp(scratch->screen, instance->framebuff, sizeof(scratch->screen)) != 0) {
+        memcpy(scratch->screen, instance->framebuff, sizeof(scratch->screen));
+        poolExpandScreen(cpu->framebuff, instance->framebuff);
+    }
+    return cpu;
+}
+
+/*
+ * Copies written pages back, giving the instance its own copy on first
+ * write; private pages are updated in place.
+ * cpu->dirty is left set for the caller if the frame drew anything.
+ */
+void poolSwapOut(InstanceScratch* scratch, Chip8Instance* instance)
+{
+    Chip8CPU* cpu = scratch->cpu;
+    const uint8_t* data;
+    int32_t i;
+
+    memcpy(instance->V, cpu->V, sizeof(instance->V));
+    instance->PC = cpu->PC;
+    instance->I  = cpu->I;
+    instance->stale = cpu->stale;
+    instance->SP = cpu->SP;
+    instance->DT = cpu->DT;
+    instance->ST = cpu->ST;
+    memcpy(instance->stack, cpu->stack, sizeof(instance->stack));
+
+    for (i = 0; i < CPU_PAGES; i++) {
+        if (!(cpu->written & (1u << i))) {
+            continue;
+        }
+        data = &cpu->ram[i * CPU_PAGE_SIZE];
+        if (instance->pages[i] == scratch->pool->image.pages[i]) {
+            poolPageRelease(instance->pages[i]);
+            instance->pages[i] = poolPageCreate(data);
+        } else {
+            memcpy(instance->pages[i]->data, data, CPU_PAGE_SIZE);
+        }
+        scratch->loaded[i] = NULL;
+    }
+    cpu->written = 0;
+
+    if (cpu->dirty) {
+        poolPackScreen(instance->framebuff, cpu->framebuff);
+        memcpy(scratch->screen, instance->framebuff, sizeof(scratch->screen));
+    }
+}
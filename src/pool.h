@@ -0,0 +1,63 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdint.h>
+#include <SDL2/SDL.h>
+#include "cpu.h"
+
+/*
+ * Compact machines for running many copies of one ROM.  An instance keeps
+ * its registers on one cache line, points at the pool's read-only image
+ * pages until it writes to one, and stores the screen at one bit per
+ * pixel.  Instances run by being swapped into a full Chip8CPU scratch.
+ */
+
+/* Private pages are rewritten in place, so unlike Page there is no hash */
+typedef struct {
+    SDL_atomic_t    refs;
+    uint8_t         data[CPU_PAGE_SIZE];
+} PoolPage;
+
+typedef struct {
+    _Alignas(CPU_ALIGN)
+    uint8_t     V[16];
+    uint16_t    PC;
+    uint16_t    I;
+    uint16_t    stale;              /* pages whose recompiled code no longer matches */
+    uint8_t     SP;
+    uint8_t     DT;
+    uint8_t     ST;
+    uint16_t    stack[STACK_SIZE];
+
+    PoolPage*   pages[CPU_PAGES];   /* image page, or a private copy once written */
+    uint8_t     framebuff[FRAMEBUFF_SIZE / 8];
+} Chip8Instance;
+
+typedef struct {
+    Chip8Instance*  slab;
+    int32_t*        freeList;
+    int32_t         freeCount;
+    int32_t         capacity;
+    SDL_SpinLock    lock;
+    Chip8Instance   image;
+} InstancePool;
+
+/* One per thread; remembers which image pages and screen its cpu already holds */
+typedef struct {
+    const InstancePool* pool;
+    Chip8CPU*           cpu;
+    const PoolPage*     loaded[CPU_PAGES];
+    uint8_t             screen[FRAMEBUFF_SIZE / 8];
+} InstanceScratch;
+
+int32_t poolInit(InstancePool* pool, const Chip8CPU* cpu, int32_t capacity);
+void poolExit(InstancePool* pool);
+Chip8Instance* poolAcquire(InstancePool* pool);
+void poolRelease(InstancePool* pool, Chip8Instance* instance);
+
+int32_t poolScratchInit(InstanceScratch* scratch, const InstancePool* pool);
+void poolScratchExit(InstanceScratch* scratch);
+Chip8CPU* poolSwapIn(InstanceScratch* scratch, const Chip8Instance* instance);
+void poolSwapOut(InstanceScratch* scratch, Chip8Instance* instance);
+
+#endif
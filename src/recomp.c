@@ -0,0 +1,679 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "recomp.h"
+
+/* Longest single store, Fx55 with x = F */
+#define STORE_SPAN      16
+
+/* How an instruction affects control flow */
+typedef enum {
+    FLOW_INVALID,
+    FLOW_NEXT,
+    FLOW_JUMP,
+    FLOW_CALL,
+    FLOW_SKIP,
+    FLOW_WAIT,
+    FLOW_RETURN,
+    FLOW_INDIRECT
+} flow_t;
+
+/* Translator state */
+static uint8_t isCode[RAM_SIZE + 2];
+static uint8_t isLeader[RAM_SIZE + 2];
+static uint16_t worklist[RAM_SIZE];
+static uint16_t blockPages[RAM_SIZE + 2];
+
+/* Runtime state */
+static void* library = NULL;
+static const RecompModule* module = NULL;
+
+static flow_t recompFlow(uint16_t opcode)
+{
+    switch (opcode & 0xF000) {
+        case 0x0000:
+            if (opcode == 0x00E0)
+                return FLOW_NEXT;
+            if (opcode == 0x00EE)
+                return FLOW_RETURN;
+            if (opcode == 0x0000)
+                return FLOW_INDIRECT;
+            return FLOW_INVALID;
+
+        case 0x1000:
+            return FLOW_JUMP;
+
+        case 0x2000:
+            return FLOW_CALL;
+
+        case 0x3000:
+        case 0x4000:
+        case 0x5000:
+        case 0x9000:
+            return FLOW_SKIP;
+
+        case 0x8000:
+            switch (opcode & 0x000F) {
+                case 0x0000: case 0x0001: case 0x0002: case 0x0003:
+                case 0x0004: case 0x0005: case 0x0006: case 0x0007:
+                case 0x000E:
+                    return FLOW_NEXT;
+                default:
+                    return FLOW_INVALID;
+            }
+
+        case 0xB000:
+            return FLOW_INDIRECT;
+
+        case 0xE000:
+            switch (opcode & 0x00FF) {
+                case 0x009E:
+                case 0x00A1:
+                    return FLOW_SKIP;
+                default:
+                    return FLOW_INVALID;
+            }
+
+        case 0xF000:
+            switch (opcode & 0x00FF) {
+                case 0x000A:
+                    return FLOW_WAIT;
+                case 0x0007: case 0x0015: case 0x0018: case 0x001E:
+                case 0x0029: case 0x0033: case 0x0055: case 0x0065:
+                    return FLOW_NEXT;
+                default:
+                    return FLOW_INVALID;
+            }
+
+        default:
+            return FLOW_NEXT;
+    }
+}
+
+/*
+ * Recursive descent from the entry point.  Every branch target, return
+ * address and skip target becomes a block leader.  Targets of Bnnn and
+ * returns are not followed; they run through the interpreter unless they
+ * land on code that was found some other way.
+ */
+static void recompDiscover(Chip8CPU* cpu, int32_t romEnd)
+{
+    int32_t count = 0;
+    uint16_t a, opcode;
+
+    memset(isCode, 0, sizeof(isCode));
+    memset(isLeader, 0, sizeof(isLeader));
+
+    isLeader[ROM_START] = 1;
+    worklist[count++] = ROM_START;
+
+#define LEADER(addr) do {                                               \
+        uint16_t t = (addr);                                            \
+        if (t >= ROM_START && t + 1 < romEnd && !isLeader[t]) {         \
+            isLeader[t] = 1;                                            \
+            worklist[count++] = t;                                      \
+        }                                                               \
+    } while (0)
+
+    while (count > 0) {
+        a = worklist[--count];
+
+        while (a >= ROM_START && a + 1 < romEnd && !isCode[a]) {
+            opcode = (cpu->ram[a] << 8) | cpu->ram[a + 1];
+            flow_t flow = recompFlow(opcode);
+            if (flow == FLOW_INVALID) {
+                break;
+            }
+            isCode[a] = 1;
+
+            if (flow == FLOW_NEXT) {
+                a += 2;
+                continue;
+            }
+
+            switch (flow) {
+                case FLOW_JUMP:
+                    LEADER(OP_NNN(opcode));
+                    break;
+                case FLOW_CALL:
+                    LEADER(OP_NNN(opcode));
+                    LEADER(a + 2);
+                    break;
+                case FLOW_SKIP:
+                    LEADER(a + 2);
+                    LEADER(a + 4);
+                    break;
+                case FLOW_WAIT:
+                    /* Fx0A repeats until a key is down, so it is its own block */
+                    isLeader[a] = 1;
+                    LEADER(a + 2);
+                    break;
+                default:
+                    break;
+            }
+            break;
+        }
+    }
+
+#undef LEADER
+}
+
+/* unspent gives back the rest of the block when the fast path stops early */
+static void recompEmitStore(FILE* fp, uint16_t a, int32_t len, int32_t romEnd, int32_t unspent)
+{
+    fprintf(fp, "    CPU_MARK_WRITTEN(cpu, cpu->I, %d);\n", len);
+    fprintf(fp, "    if (cpu->I + %d > 0x%03x && cpu->I < 0x%03x) {\n", len, ROM_START, romEnd);
+    fprintf(fp, "        cpu->PC = 0x%03x;\n", a + 2);
+    fprintf(fp, "        return (budget + %d) | RECOMP_WROTE_CODE;\n", unspent);
+    fprintf(fp, "    }\n");
+}
+
+/* Jumps to a block found by discovery are direct calls, anything else is looked up */
+static void recompEmitChain(FILE* fp, const char* indent, uint32_t target)
+{
+    if (target < RAM_SIZE && isLeader[target] && isCode[target]) {
+        fprintf(fp, "%sCHAIN_TO(0x%03x, block_%03x, 0x%04x);\n", indent, target, target, blockPages[target]);
+    } else {
+        fprintf(fp, "%sCHAIN(0x%03x);\n", indent, target);
+    }
+}
+
+static void recompEmitSkip(FILE* fp, const char* cond, uint16_t a)
+{
+    fprintf(fp, "    if (%s) {\n", cond);
+    recompEmitChain(fp, "        ", a + 4);
+    fprintf(fp, "    }\n");
+    recompEmitChain(fp, "    ", a + 2);
+}
+
+/* Emits one instruction with the same semantics as cpuExecute */
+static void recompEmit(FILE* fp, uint16_t a, uint16_t opcode, int32_t romEnd, int32_t unspent)
+{
+    uint16_t addr = OP_NNN(opcode);
+    uint8_t  n    = OP_N(opcode);
+    uint8_t  x    = OP_X(opcode);
+    uint8_t  y    = OP_Y(opcode);
+    uint8_t  kk   = OP_KK(opcode);
+    char cond[32];
+
+    switch (opcode & 0xF000) {
+        case 0x0000:
+            if (opcode == 0x00E0) {
+                fprintf(fp, "    memset(cpu->framebuff, 0, FRAMEBUFF_SIZE);\n");
+                fprintf(fp, "    cpu->dirty = 1;\n");
+            } else if (opcode == 0x00EE) {
+                fprintf(fp, "    cpu->SP--;\n");
+                fprintf(fp, "    CHAIN(cpu->stack[cpu->SP]);\n");
+            } else {
+                recompEmitChain(fp, "    ", addr);
+            }
+            break;
+
+        case 0x1000:
+            recompEmitChain(fp, "    ", addr);
+            break;
+
+        case 0x2000:
+            fprintf(fp, "    cpu->stack[cpu->SP] = 0x%03x;\n", a + 2);
+            fprintf(fp, "    cpu->SP++;\n");
+            recompEmitChain(fp, "    ", addr);
+            break;
+
+        case 0x3000:
+            snprintf(cond, sizeof(cond), "cpu->V[%d] == 0x%02x", x, kk);
+            recompEmitSkip(fp, cond, a);
+            break;
+
+        case 0x4000:
+            snprintf(cond, sizeof(cond), "cpu->V[%d] != 0x%02x", x, kk);
+            recompEmitSkip(fp, cond, a);
+            break;
+
+        case 0x5000:
+            snprintf(cond, sizeof(cond), "cpu->V[%d] == cpu->V[%d]", x, y);
+            recompEmitSkip(fp, cond, a);
+            break;
+
+        case 0x6000:
+            fprintf(fp, "    cpu->V[%d] = 0x%02x;\n", x, kk);
+            break;
+
+        case 0x7000:
+            fprintf(fp, "    cpu->V[%d] += 0x%02x;\n", x, kk);
+            break;
+
+        case 0x8000:
+            switch (opcode & 0x000F) {
+                case 0x0000:
+                    fprintf(fp, "    cpu->V[%d] = cpu->V[%d];\n", x, y);
+                    break;
+                case 0x0001:
+                    fprintf(fp, "    cpu->V[%d] |= cpu->V[%d];\n", x, y);
+                    break;
+                case 0x0002:
+                    fprintf(fp, "    cpu->V[%d] &= cpu->V[%d];\n", x, y);
+                    break;
+                case 0x0003:
+                    fprintf(fp, "    cpu->V[%d] ^= cpu->V[%d];\n", x, y);
+                    break;
+                case 0x0004:
+                    fprintf(fp, "    cpu->V[15] = (cpu->V[%d] + cpu->V[%d] > 255) ? 1 : 0;\n", x, y);
+                    fprintf(fp, "    cpu->V[%d] += cpu->V[%d];\n", x, y);
+                    break;
+                case 0x0005:
+                    fprintf(fp, "    cpu->V[15] = (cpu->V[%d] > cpu->V[%d]) ? 1 : 0;\n", x, y);
+                    fprintf(fp, "    cpu->V[%d] -= cpu->V[%d];\n", x, y);
+                    break;
+                case 0x0006:
+                    fprintf(fp, "    cpu->V[15] = cpu->V[%d] & 0x01;\n", x);
+                    fprintf(fp, "    cpu->V[%d] >>= 1;\n", x);
+                    break;
+                case 0x0007:
+                    fprintf(fp, "    cpu->V[15] = (cpu->V[%d] > cpu->V[%d]) ? 1 : 0;\n", y, x);
+                    fprintf(fp, "    cpu->V[%d] = cpu->V[%d] - cpu->V[%d];\n", x, y, x);
+                    break;
+                case 0x000E:
+                    fprintf(fp, "    cpu->V[15] = (cpu->V[%d] >> 7);\n", x);
+                    fprintf(fp, "    cpu->V[%d] <<= 1;\n", x);
+                    break;
+            }
+            break;
+
+        case 0x9000:
+            snprintf(cond, sizeof(cond), "cpu->V[%d] != cpu->V[%d]", x, y);
+            recompEmitSkip(fp, cond, a);
+            break;
+
+        case 0xA000:
+            fprintf(fp, "    cpu->I = 0x%03x;\n", addr);
+            break;
+
+        case 0xB000:
+            fprintf(fp, "    CHAIN(cpu->V[0] + 0x%03x);\n", addr);
+            break;
+
+        case 0xC000:
+            fprintf(fp, "    cpu->V[%d] = (rand() %% 256) & 0x%02x;\n", x, kk);
+            break;
+
+        case 0xD000:
+            fprintf(fp, "    cpuDrawSprite(cpu, %d, %d, %d);\n", x, y, n);
+            break;
+
+        case 0xE000:
+            snprintf(cond, sizeof(cond), "%scpu->key[ cpu->V[%d] ]", (kk == 0x9E) ? "" : "!", x);
+            recompEmitSkip(fp, cond, a);
+            break;
+
+        case 0xF000:
+            switch (opcode & 0x00FF) {
+                case 0x0007:
+                    fprintf(fp, "    cpu->V[%d] = cpu->DT;\n", x);
+                    break;
+                case 0x000A:
+                    fprintf(fp, "    for (int32_t i = 0; i < KEY_SIZE; i++) {\n");
+                    fprintf(fp, "        if (cpu->key[i]) {\n");
+                    fprintf(fp, "            cpu->V[%d] = i;\n", x);
+                    recompEmitChain(fp, "            ", a + 2);
+                    fprintf(fp, "        }\n");
+                    fprintf(fp, "    }\n");
+                    /* Keys only change between runs, so the wait lasts the rest of the budget */
+                    fprintf(fp, "    cpu->PC = 0x%03x;\n", a);
+                    fprintf(fp, "    return 0;\n");
+                    break;
+                case 0x0015:
+                    fprintf(fp, "    cpu->DT = cpu->V[%d];\n", x);
+                    break;
+                case 0x0018:
+                    fprintf(fp, "    cpu->ST = cpu->V[%d];\n", x);
+                    break;
+                case 0x001E:
+                    fprintf(fp, "    cpu->I += cpu->V[%d];\n", x);
+                    break;
+                case 0x0029:
+                    fprintf(fp, "    cpu->I = 5 * cpu->V[%d];\n", x);
+                    break;
+                case 0x0033:
+                    fprintf(fp, "    cpu->ram[cpu->I]     = (cpu->V[%d] / 100);\n", x);
+                    fprintf(fp, "    cpu->ram[cpu->I + 1] = (cpu->V[%d] / 10) %% 10;\n", x);
+                    fprintf(fp, "    cpu->ram[cpu->I + 2] = (cpu->V[%d] %% 10);\n", x);
+                    recompEmitStore(fp, a, 3, romEnd, unspent);
+                    break;
+                case 0x0055:
+                    fprintf(fp, "    for (int32_t i = 0; i <= %d; i++) {\n", x);
+                    fprintf(fp, "        cpu->ram[cpu->I + i] = cpu->V[i];\n");
+                    fprintf(fp, "    }\n");
+                    recompEmitStore(fp, a, x + 1, romEnd, unspent);
+                    break;
+                case 0x0065:
+                    fprintf(fp, "    for (int32_t i = 0; i <= %d; i++) {\n", x);
+                    fprintf(fp, "        cpu->V[i] = cpu->ram[cpu->I + i];\n");
+                    fprintf(fp, "    }\n");
+                    break;
+            }
+            break;
+
+    }
+}
+
+/* A block runs until control flow, an instruction that was not found, or a leader */
+static int32_t recompBlockEnd(Chip8CPU* cpu, int32_t start)
+{
+    int32_t a = start;
+    uint16_t opcode;
+
+    for (;;) {
+        opcode = (cpu->ram[a] << 8) | cpu->ram[a + 1];
+        if (recompFlow(opcode) != FLOW_NEXT || !isCode[a + 2] || isLeader[a + 2])
+            return a + 2;
+        a += 2;
+    }
+}
+
+/*
+ * Fx07 / 3xkk or 4xkk / jump back is the usual way to wait on the delay
+ * timer.  DT only changes between runs, so once the test fails the loop
+ * spins for the rest of the budget; PC ends wherever that count leaves it.
+ * The loop has to share a page with the Fx07 so a write to it makes this
+ * block stale.
+ */
+static void recompEmitDelayLoop(FILE* fp, Chip8CPU* cpu, uint16_t a, int32_t unspent)
+{
+    uint16_t skip, jump;
+    uint8_t  x = cpu->ram[a] & 0x0F;
+
+    if ((a >> CPU_PAGE_SHIFT) != ((a + 5) >> CPU_PAGE_SHIFT) || !isCode[a + 2] || !isCode[a + 4]) {
+        return;
+    }
+    skip = (cpu->ram[a + 2] << 8) | cpu->ram[a + 3];
+    jump = (cpu->ram[a + 4] << 8) | cpu->ram[a + 5];
+    if (((skip & 0xF000) != 0x3000 && (skip & 0xF000) != 0x4000) ||
+        OP_X(skip) != x || jump != (0x1000 | a)) {
+        return;
+    }
+
+    fprintf(fp, "    if (cpu->V[%d] %s 0x%02x) {\n", x, (skip & 0xF000) == 0x3000 ? "!=" : "==", OP_KK(skip));
+    fprintf(fp, "        cpu->PC = 0x%03x + 2 * ((budget + %d + 1) %% 3);\n", a, unspent);
+    fprintf(fp, "        return 0;\n");
+    fprintf(fp, "    }\n");
+}
+
+static void recompEmitBlock(FILE* fp, Chip8CPU* cpu, int32_t start, int32_t end, int32_t romEnd, bool fast)
+{
+    uint16_t opcode;
+    char text[32];
+    int32_t a;
+
+    for (a = start; a < end; a += 2) {
+        opcode = (cpu->ram[a] << 8) | cpu->ram[a + 1];
+        cpuDisassembleOpcode(opcode, text, sizeof(text));
+        fprintf(fp, "\n%c%03x: /* %s */\n", fast ? 'F' : 'L', a, text);
+        if (fast) {
+            recompEmit(fp, a, opcode, romEnd, (end - a - 2) / 2);
+        } else {
+            fprintf(fp, "    if (budget == 0) {\n");
+            fprintf(fp, "        cpu->PC = 0x%03x;\n", a);
+            fprintf(fp, "        return 0;\n");
+            fprintf(fp, "    }\n");
+            fprintf(fp, "    budget--;\n");
+            recompEmit(fp, a, opcode, romEnd, 0);
+        }
+        if ((opcode & 0xF0FF) == 0xF007) {
+            recompEmitDelayLoop(fp, cpu, a, fast ? (end - a - 2) / 2 : 0);
+        }
+    }
+
+    opcode = (cpu->ram[end - 2] << 8) | cpu->ram[end - 1];
+    if (recompFlow(opcode) == FLOW_NEXT) {
+        recompEmitChain(fp, "    ", end);
+    }
+}
+
+static const char* RecompPrologue =
+    "#include <stdlib.h>\n"
+    "#include <string.h>\n"
+    "#include \"recomp.h\"\n"
+    "\n"
+    "static RecompEntry entries[RAM_SIZE];\n"
+    "\n"
+    "/* Continue straight into the next block while budget remains and its code is intact */\n"
+    "#define CHAIN(pc) do {                                      \\\n"
+    "        cpu->PC = (pc);                                     \\\n"
+    "        if (budget > 0 && cpu->PC < RAM_SIZE && entries[cpu->PC].fn != NULL && \\\n"
+    "            !(cpu->stale & entries[cpu->PC].pages))         \\\n"
+    "            return entries[cpu->PC].fn(cpu, budget);        \\\n"
+    "        return budget;                                      \\\n"
+    "    } while (0)\n"
+    "\n"
+    "#define CHAIN_TO(pc, fn, pages) do {                        \\\n"
+    "        cpu->PC = (pc);                                     \\\n"
+    "        if (budget > 0 && !(cpu->stale & (pages)))          \\\n"
+    "            return fn(cpu, budget);                         \\\n"
+    "        return budget;                                      \\\n"
+    "    } while (0)\n";
+
+int32_t recompTranslate(Chip8CPU* cpu, int32_t romSize, const char* file)
+{
+    int32_t romEnd = ROM_START + romSize;
+    int32_t a, start, end, blocks = 0, i;
+    FILE* fp;
+
+    size_t len = strlen(file);
+
+    if (romSize <= 0) {
+        return -1;
+    }
+
+    /* Guard against swapped arguments clobbering the ROM */
+    if (len < 2 || strcmp(file + len - 2, ".c") != 0) {
+        fp = fopen(file, "r");
+        if (fp != NULL) {
+            fclose(fp);
+            fprintf(stderr, "Refusing to overwrite %s; the output should be a .c file.\n", file);
+            return -1;
+        }
+    }
+
+    fp = fopen(file, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "Error opening output file: %s\n", file);
+        return -1;
+    }
+
+    recompDiscover(cpu, romEnd);
+    for (start = ROM_START; start < romEnd; start++) {
+        if (isLeader[start] && isCode[start]) {
+            blockPages[start] = RECOMP_PAGES(start, recompBlockEnd(cpu, start));
+        }
+    }
+
+    fprintf(fp, "/* Recompiled CHIP-8 ROM, generated by chip8 -c */\n");
+    fputs(RecompPrologue, fp);
+
+    fprintf(fp, "\n");
+    for (start = ROM_START; start < romEnd; start++) {
+        if (isLeader[start] && isCode[start]) {
+            fprintf(fp, "static int32_t block_%03x(Chip8CPU* cpu, int32_t budget);\n", start);
+        }
+    }
+
+    /*
+     * One function per basic block, enterable at any of its instructions.
+     * When the budget covers the rest of the block it is charged once and
+     * a copy without the per-instruction budget check runs.
+     */
+    for (start = ROM_START; start < romEnd; start++) {
+        if (!isLeader[start] || !isCode[start]) {
+            continue;
+        }
+        end = recompBlockEnd(cpu, start);
+
+        fprintf(fp, "\nstatic int32_t block_%03x(Chip8CPU* cpu, int32_t budget)\n{\n", start);
+        fprintf(fp, "    if (cpu->PC == 0x%03x && budget >= %d) {\n", start, (end - start) / 2);
+        fprintf(fp, "        budget -= %d;\n", (end - start) / 2);
+        fprintf(fp, "        goto F%03x;\n", start);
+        fprintf(fp, "    }\n");
+        fprintf(fp, "    switch (cpu->PC) {\n");
+        for (a = start; a < end; a += 2) {
+            fprintf(fp, "        case 0x%03x: if (budget >= %d) { budget -= %d; goto F%03x; } goto L%03x;\n",
+                    a, (end - a) / 2, (end - a) / 2, a, a);
+        }
+        fprintf(fp, "        default: return budget;\n");
+        fprintf(fp, "    }\n");
+
+        recompEmitBlock(fp, cpu, start, end, romEnd, true);
+        recompEmitBlock(fp, cpu, start, end, romEnd, false);
+        fprintf(fp, "}\n");
+        blocks++;
+    }
+
+    fprintf(fp, "\nstatic const uint8_t rom[%d] = {", romSize);
+    for (i = 0; i < romSize; i++) {
+        fprintf(fp, "%s0x%02x,", (i % 12) ? " " : "\n    ", cpu->ram[ROM_START + i]);
+    }
+    fprintf(fp, "\n};\n");
+
+    fprintf(fp, "\nstatic const RecompBlock blocks[%d] = {\n", blocks);
+    for (start = ROM_START; start < romEnd; start++) {
+        if (isLeader[start] && isCode[start]) {
+            fprintf(fp, "    { 0x%03x, 0x%03x, block_%03x },\n", start, recompBlockEnd(cpu, start), start);
+        }
+    }
+    fprintf(fp, "};\n");
+
+    fprintf(fp, "\nconst RecompModule %s = {\n", RECOMP_SYMBOL);
+    fprintf(fp, "    RECOMP_VERSION,\n");
+    fprintf(fp, "    sizeof(Chip8CPU),\n");
+    fprintf(fp, "    %d,\n", romSize);
+    fprintf(fp, "    rom,\n");
+    fprintf(fp, "    %d,\n", blocks);
+    fprintf(fp, "    blocks,\n");
+    fprintf(fp, "    entries\n");
+    fprintf(fp, "};\n");
+
+    fclose(fp);
+    printf("Translated %d basic blocks to %s\n", blocks, file);
+    return 0;
+}
+
+/*
+ * A block only runs on a machine while the bytes it was compiled from are
+ * unchanged in that machine's RAM; pages where they differ are marked in
+ * cpu->stale.  Called after any store that may have hit the ROM image.
+ */
+static void recompCheckCode(Chip8CPU* cpu, uint32_t lo, uint32_t hi)
+{
+    const RecompBlock* b;
+    uint32_t page, first, last, from, to;
+    uint16_t stale = 0;
+    int32_t i;
+
+    if (hi > RAM_SIZE) {
+        hi = RAM_SIZE;
+    }
+    if (lo >= hi) {
+        return;
+    }
+    first = lo >> CPU_PAGE_SHIFT;
+    last  = (hi - 1) >> CPU_PAGE_SHIFT;
+
+    for (i = 0; i < module->blockCount; i++) {
+        b = &module->blocks[i];
+        for (page = first; page <= last; page++) {
+            from = (b->start > page * CPU_PAGE_SIZE) ? b->start : page * CPU_PAGE_SIZE;
+            to   = (b->end < (page + 1) * CPU_PAGE_SIZE) ? b->end : (page + 1) * CPU_PAGE_SIZE;
+            if (from < to && memcmp(&cpu->ram[from], &module->rom[from - ROM_START], to - from) != 0) {
+                stale |= 1u << page;
+            }
+        }
+    }
+
+    cpu->stale &= ~RECOMP_PAGES(first * CPU_PAGE_SIZE, last * CPU_PAGE_SIZE + 1);
+    cpu->stale |= stale;
+}
+
+int32_t recompLoad(Chip8CPU* cpu, const char* file)
+{
+    const RecompBlock* b;
+    uint32_t a;
+    int32_t i;
+
+    library = SDL_LoadObject(file);
+    if (library == NULL) {
+        fprintf(stderr, "Could not load module: %s\n", SDL_GetError());
+        return -1;
+    }
+
+    module = SDL_LoadFunction(library, RECOMP_SYMBOL);
+    if (module == NULL) {
+        fprintf(stderr, "Not a recompiled ROM module: %s\n", file);
+        recompUnload();
+        return -1;
+    }
+
+    if (module->version != RECOMP_VERSION || module->cpuSize != (int32_t)sizeof(Chip8CPU)) {
+        fprintf(stderr, "Module was built for another emulator version: %s\n", file);
+        recompUnload();
+        return -1;
+    }
+
+    if (module->romSize > ROM_MAXSIZE ||
+        memcmp(&cpu->ram[ROM_START], module->rom, module->romSize) != 0) {
+        fprintf(stderr, "Module was built from a different ROM: %s\n", file);
+        recompUnload();
+        return -1;
+    }
+
+    memset(module->entries, 0, RAM_SIZE * sizeof(RecompEntry));
+    for (i = 0; i < module->blockCount; i++) {
+        b = &module->blocks[i];
+        for (a = b->start; a < b->end; a += 2) {
+            module->entries[a].fn = b->fn;
+            module->entries[a].pages = RECOMP_PAGES(b->start, b->end);
+        }
+    }
+    cpu->stale = 0;
+    return 0;
+}
+
+void recompUnload(void)
+{
+    if (library != NULL) {
+        SDL_UnloadObject(library);
+    }
+    library = NULL;
+    module = NULL;
+}
+
+void recompRun(Chip8CPU* cpu, int32_t cycles)
+{
+    const RecompEntry* entry;
+    uint16_t opcode;
+    int32_t left;
+
+    while (cycles > 0) {
+        entry = (module != NULL && cpu->PC < RAM_SIZE) ? &module->entries[cpu->PC] : NULL;
+        if (entry != NULL && entry->fn != NULL && !(cpu->stale & entry->pages)) {
+            left = entry->fn(cpu, cycles);
+            if (left & RECOMP_WROTE_CODE) {
+                left &= ~RECOMP_WROTE_CODE;
+                recompCheckCode(cpu, cpu->I, cpu->I + STORE_SPAN);
+            }
+            if (left < cycles) {
+                cycles = left;
+                continue;
+            }
+        }
+
+        /* Not recompiled, modified since, or no module loaded */
+        opcode = (cpu->ram[cpu->PC] << 8) | cpu->ram[cpu->PC + 1];
+        cpuExecute(cpu);
+        cycles--;
+
+        if (module != NULL && ((opcode & 0xF0FF) == 0xF033 || (opcode & 0xF0FF) == 0xF055)) {
+            recompCheckCode(cpu, cpu->I, cpu->I + STORE_SPAN);
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef RECOMP_H
+#define RECOMP_H
+
+#include "cpu.h"
+
+/*
+ * Shared between the emulator and recompiled ROM modules.  A module is the
+ * C file written by recompTranslate built as a shared object; it exports a
+ * RecompModule named RECOMP_SYMBOL.
+ */
+
+#define RECOMP_VERSION      3
+#define RECOMP_SYMBOL       "chip8Module"
+#define RECOMP_WROTE_CODE   0x40000000
+
+/*
+ * Runs from cpu->PC, chaining into following blocks, for at most budget
+ * instructions.  Returns the budget left over, or'ed with RECOMP_WROTE_CODE
+ * when it stopped early because a store hit the ROM image.  Keys and
+ * timers must not change during a run; waits on them use up the budget.
+ */
+typedef int32_t (*RecompBlockFn)(Chip8CPU* cpu, int32_t budget);
+
+typedef struct {
+    uint16_t        start;
+    uint16_t        end;
+    RecompBlockFn   fn;
+} RecompBlock;
+
+/*
+ * Entry points are shared by every machine running the module.  A block
+ * is skipped on a machine whose stale mask has any of its pages set.
+ */
+typedef struct {
+    RecompBlockFn   fn;
+    uint16_t        pages;
+} RecompEntry;
+
+#define RECOMP_PAGES(start, end) \
+    ((uint16_t)((2u << (((end) - 1) >> CPU_PAGE_SHIFT)) - (1u << ((start) >> CPU_PAGE_SHIFT))))
+
+typedef struct {
+    int32_t             version;
+    int32_t             cpuSize;
+    int32_t             romSize;
+    const uint8_t*      rom;
+    int32_t             blockCount;
+    const RecompBlock*  blocks;
+    RecompEntry*        entries;    /* RAM_SIZE slots, filled in by recompLoad */
+} RecompModule;
+
+int32_t recompTranslate(Chip8CPU* cpu, int32_t romSize, const char* file);
+int32_t recompLoad(Chip8CPU* cpu, const char* file);
+void recompUnload(void);
+void recompRun(Chip8CPU* cpu, int32_t cycles);
+
+#endif
@@ -0,0 +1,308 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "chip8.h"
+#include "input.h"
+#include "pool.h"
+#include "recomp.h"
+#include "wall.h"
+
+/*
+ * Wall mode runs many machines on worker threads and shows them as a grid
+ * in one window.  Every machine owns a tile in a single streaming texture;
+ * workers publish a snapshot of the framebuffer after each frame that drew
+ * something, and the UI thread uploads only those tiles before presenting
+ * the whole atlas with one copy.  Machines are compact pool instances
+ * sharing the ROM image, swapped into a per-worker scratch CPU to run.
+ * A recompiled module is shared by all of them; each instance carries its
+ * own mask of pages whose code it has overwritten.
+ */
+
+#define TILE_WIDTH      (SCREEN_WIDTH + 1)
+#define TILE_HEIGHT     (SCREEN_HEIGHT + 1)
+#define GUTTER_COLOR    0x00404040
+
+typedef struct {
+    Chip8Instance*  instance;
+    SDL_SpinLock    lock;
+    SDL_atomic_t    changed;
+    uint8_t         snapshot[FRAMEBUFF_SIZE];
+} WallTile;
+
+typedef struct {
+    SDL_Thread*     thread;
+    InstanceScratch scratch;
+    int32_t         first;
+    int32_t         stride;
+} WallWorker;
+
+static InstancePool pool;
+static WallTile* tiles = NULL;
+static int32_t tileCount = 0;
+static SDL_atomic_t running;
+static SDL_atomic_t keyMask;
+
+static int wallWorker(void* data)
+{
+    WallWorker* worker = data;
+    WallTile* tile;
+    Chip8CPU* cpu;
+    uint32_t keys;
+    int32_t i, k, t0, elapsed;
+
+    while (SDL_AtomicGet(&running)) {
+        t0 = SDL_GetTicks();
+        keys = (uint32_t)SDL_AtomicGet(&keyMask);
+
+        for (i = worker->first; i < tileCount; i += worker->stride) {
+            tile = &tiles[i];
+            cpu = poolSwapIn(&worker->scratch, tile->instance);
+            for (k = 0; k < KEY_SIZE; k++) {
+                cpu->key[k] = (keys >> k) & 1;
+            }
+            recompRun(cpu, CYCLES_PER_FRAME_TIME);
+            cpuUpdateTimers(cpu);
+            poolSwapOut(&worker->scratch, tile->instance);
+
+            if (cpu->dirty) {
+                SDL_AtomicLock(&tile->lock);
+                memcpy(tile->snapshot, cpu->framebuff, FRAMEBUFF_SIZE);
+                SDL_AtomicUnlock(&tile->lock);
+                SDL_AtomicSet(&tile->changed, 1);
+            }
+        }
+
+        elapsed = SDL_GetTicks() - t0;
+        if (elapsed < FRAME_TIME_MS) {
+            SDL_Delay(FRAME_TIME_MS - elapsed);
+        }
+    }
+    return 0;
+}
+
+/* Near-square grid of tiles with a one-pixel gutter between them */
+static void wallLayout(int32_t count, int32_t* cols, int32_t* width, int32_t* height)
+{
+    int32_t rows;
+
+    *cols = 1;
+    while (*cols * *cols < count) {
+        (*cols)++;
+    }
+    rows    = (count + *cols - 1) / *cols;
+    *width  = *cols * TILE_WIDTH - 1;
+    *height = rows * TILE_HEIGHT - 1;
+}
+
+/* The grid is a single texture, so it has to fit the renderer's limit */
+static int32_t wallFit(SDL_Renderer* renderer, int32_t count)
+{
+    SDL_RendererInfo info;
+    int32_t cols, width, height;
+
+    if (SDL_GetRendererInfo(renderer, &info) != 0) {
+        return count;
+    }
+
+    for (; count > 1; count--) {
+        wallLayout(count, &cols, &width, &height);
+        if ((info.max_texture_width == 0 || width <= info.max_texture_width) &&
+            (info.max_texture_height == 0 || height <= info.max_texture_height)) {
+            break;
+        }
+    }
+    return count;
+}
+
+static void wallUpload(SDL_Texture* atlas, int32_t cols)
+{
+    static uint8_t framebuff[FRAMEBUFF_SIZE];
+    static uint32_t pixels[FRAMEBUFF_SIZE];
+    palette_t pal = filterGetPalette();
+    SDL_Rect rect = { 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT };
+    int32_t i;
+
+    for (i = 0; i < tileCount; i++) {
+        if (!SDL_AtomicSet(&tiles[i].changed, 0)) {
+            continue;
+        }
+
+        SDL_AtomicLock(&tiles[i].lock);
+        memcpy(framebuff, tiles[i].snapshot, FRAMEBUFF_SIZE);
+        SDL_AtomicUnlock(&tiles[i].lock);
+
+        filterExpand(framebuff, pixels, FRAMEBUFF_SIZE, pal);
+        rect.x = (i % cols) * TILE_WIDTH;
+        rect.y = (i / cols) * TILE_HEIGHT;
+        SDL_UpdateTexture(atlas, &rect, pixels, SCREEN_WIDTH * sizeof(uint32_t));
+    }
+}
+
+int32_t wallRun(const char* file, int32_t count, const char* module)
+{
+    SDL_Window* window;
+    SDL_Renderer* renderer;
+    SDL_Texture* atlas;
+    SDL_Event event;
+    WallWorker* workers;
+    Chip8CPU* image;
+    uint32_t* clear;
+    int32_t i, cols, width, height, scale, workerCount, t0, elapsed;
+    bool quit = false;
+
+    if (count < 1 || count > WALL_MAX_INSTANCES) {
+        fprintf(stderr, "Wall supports 1 to %d instances.\n", WALL_MAX_INSTANCES);
+        return -1;
+    }
+
+    tileCount = count;
+    tiles = calloc(count, sizeof(WallTile));
+    if (tiles == NULL) {
+        fprintf(stderr, "malloc error.\n");
+        return -1;
+    }
+
+    image = aligned_alloc(CPU_ALIGN, sizeof(Chip8CPU));
+    if (image == NULL) {
+        fprintf(stderr, "malloc error.\n");
+        return -1;
+    }
+    cpuInit(image);
+    if (chip8LoadROM(image, file) <= 0 ||
+        (module != NULL && recompLoad(image, module) != 0) ||
+        poolInit(&pool, image, count) != 0) {
+        recompUnload();
+        free(image);
+        free(tiles);
+        tiles = NULL;
+        return -1;
+    }
+    free(image);
+
+    wallLayout(count, &cols, &width, &height);
+    scale = (WINDOW_WIDTH / width > 1) ? WINDOW_WIDTH / width : 1;
+
+    SDL_Init(SDL_INIT_VIDEO);
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "nearest");
+
+    window = SDL_CreateWindow("Chip8 Emulator",
+                              SDL_WINDOWPOS_CENTERED,
+                              SDL_WINDOWPOS_CENTERED,
+                              width * scale,
+                              height * scale,
+                              SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
+    if (window == NULL) {
+        fprintf(stderr, "Could not create window: %s\n", SDL_GetError());
+        exit(1);
+    }
+
+    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    if (renderer == NULL) {
+        fprintf(stderr, "Could not create renderer: %s\n", SDL_GetError());
+    }
+
+    tileCount = wallFit(renderer, count);
+    if (tileCount < count) {
+        fprintf(stderr, "Showing %d instances, the most this renderer's textures can hold.\n", tileCount);
+        wallLayout(tileCount, &cols, &width, &height);
+        scale = (WINDOW_WIDTH / width > 1) ? WINDOW_WIDTH / width : 1;
+        SDL_SetWindowSize(window, width * scale, height * scale);
+    }
+    for (i = 0; i < tileCount; i++) {
+        tiles[i].instance = poolAcquire(&pool);
+        SDL_AtomicSet(&tiles[i].changed, 1);
+    }
+    SDL_RenderSetLogicalSize(renderer, width, height);
+
+    atlas = SDL_CreateTexture(renderer,
+                              SDL_PIXELFORMAT_ARGB8888,
+                              SDL_TEXTUREACCESS_STREAMING,
+                              width,
+                              height);
+    if (atlas == NULL) {
+        fprintf(stderr, "Could not create texture: %s\n", SDL_GetError());
+        exit(1);
+    }
+
+    /* Paint the gutters once; tiles are only ever uploaded over them */
+    clear = malloc(width * height * sizeof(uint32_t));
+    if (clear != NULL) {
+        for (i = 0; i < width * height; i++) {
+            clear[i] = GUTTER_COLOR;
+        }
+        SDL_UpdateTexture(atlas, NULL, clear, width * sizeof(uint32_t));
+        free(clear);
+    }
+
+    inputInit(INPUT_MASK_ONLY, false);
+    SDL_AtomicSet(&keyMask, 0);
+    SDL_AtomicSet(&running, 1);
+
+    workerCount = SDL_GetCPUCount();
+    if (workerCount > tileCount) {
+        workerCount = tileCount;
+    }
+    workers = calloc(workerCount, sizeof(WallWorker));
+    if (workers == NULL) {
+        fprintf(stderr, "malloc error.\n");
+        exit(1);
+    }
+    for (i = 0; i < workerCount; i++) {
+        if (poolScratchInit(&workers[i].scratch, &pool) != 0) {
+            exit(1);
+        }
+        workers[i].first = i;
+        workers[i].stride = workerCount;
+        workers[i].thread = SDL_CreateThread(wallWorker, "wall", &workers[i]);
+    }
+
+    while (!quit) {
+        t0 = SDL_GetTicks();
+
+        while (SDL_PollEvent(&event)) {
+            if (event.type == SDL_QUIT ||
+                (event.type == SDL_KEYDOWN && event.key.keysym.scancode == SDL_SCANCODE_ESCAPE)) {
+                quit = true;
+            }
+            inputHandleEvent(&event);
+        }
+
+        /* Every machine sees the same keyboard */
+        SDL_AtomicSet(&keyMask, (int)inputKeyMask());
+
+        wallUpload(atlas, cols);
+
+        SDL_RenderClear(renderer);
+        SDL_RenderCopy(renderer, atlas, NULL, NULL);
+        SDL_RenderPresent(renderer);
+
+        elapsed = SDL_GetTicks() - t0;
+        if (elapsed < FRAME_TIME_MS) {
+            SDL_Delay(FRAME_TIME_MS - elapsed);
+        }
+    }
+
+    SDL_AtomicSet(&running, 0);
+    for (i = 0; i < workerCount; i++) {
+        SDL_WaitThread(workers[i].thread, NULL);
+        poolScratchExit(&workers[i].scratch);
+    }
+    free(workers);
+    inputExit();
+
+    for (i = 0; i < tileCount; i++) {
+        poolRelease(&pool, tiles[i].instance);
+    }
+    poolExit(&pool);
+    recompUnload();
+    free(tiles);
+    tiles = NULL;
+
+    SDL_DestroyTexture(atlas);
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+    return 0;
+}
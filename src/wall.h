@@ -0,0 +1,10 @@
+#ifndef WALL_H
+#define WALL_H
+
+#include <stdint.h>
+
+#define WALL_MAX_INSTANCES  1024
+
+int32_t wallRun(const char* file, int32_t count, const char* module);
+
+#endif